@@ -0,0 +1,52 @@
+#include "stream-shell/config.h"
+
+#include <benchmark/benchmark.h>
+#include <google/protobuf/util/json_util.h>
+#include "stream-shell/test/test_env.h"
+
+namespace {
+
+TestEnv env;
+
+google::protobuf::Value makeString(std::string str) {
+  google::protobuf::Value value;
+  value.set_string_value(std::move(str));
+  return value;
+}
+
+google::protobuf::Value makeStruct(std::string_view json) {
+  google::protobuf::Value value;
+  (void)google::protobuf::json::JsonStringToMessage(json, value.mutable_struct_value()).ok();
+  return value;
+}
+
+// git -C ~/src commit -am 'message' --no-verify HEAD
+void toConfigCommand(benchmark::State &state) {
+  std::vector<Operand> operands = {
+      makeStruct(R"({ "C": "~/src" })"),
+      makeString("commit"),
+      makeStruct(R"({ "a": true, "m": "message", "verify": false })"),
+      makeString("HEAD"),
+  };
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(toConfig(env, operands));
+  }
+}
+BENCHMARK(toConfigCommand);
+
+// Same command, with its config built up front
+void commandConfig(benchmark::State &state) {
+  CommandConfig config(env,
+                       {
+                           makeStruct(R"({ "C": "~/src" })"),
+                           makeString("commit"),
+                           makeStruct(R"({ "a": true, "m": "message", "verify": false })"),
+                           makeString("HEAD"),
+                       });
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(config());
+  }
+}
+BENCHMARK(commandConfig);
+
+}  // namespace
@@ -0,0 +1,51 @@
+#include "stream-shell/builtins/get.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace std::string_view_literals;
+
+namespace {
+
+// { items: [{ n: 0 }, { n: 1 }, ...] }
+Value makeRecord(int size) {
+  google::protobuf::Value record;
+  auto &items = (*record.mutable_struct_value()->mutable_fields())["items"];
+  for (int i = 0; i < size; ++i) {
+    auto &item = *items.mutable_list_value()->add_values();
+    (*item.mutable_struct_value()->mutable_fields())["n"].set_number_value(i);
+  }
+  return record;
+}
+
+void lookupFieldBatch(benchmark::State &state) {
+  auto record = makeRecord(state.range(0));
+  Batch out;
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto input = record;
+    out.clear();
+    state.ResumeTiming();
+
+    lookupField(std::move(input), "items"sv | ranges::views::split('.'), out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(lookupFieldBatch)->Range(1, 1 << 12);
+
+void lookupFieldStream(benchmark::State &state) {
+  auto record = makeRecord(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto input = record;
+    state.ResumeTiming();
+
+    for (auto &&result : lookupField(std::move(input), "items"sv | ranges::views::split('.'))) {
+      benchmark::DoNotOptimize(result);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(lookupFieldStream)->Range(1, 1 << 12);
+
+}  // namespace
@@ -0,0 +1,77 @@
+#include "stream-shell/stream_parser.h"
+
+#include <format>
+#include <benchmark/benchmark.h>
+#include "stream-shell/test/test_env.h"
+#include "stream-shell/tokenize.h"
+
+using namespace std::string_literals;
+
+namespace {
+
+TestEnv env;
+
+void consume(Stream stream) {
+  for (auto &&result : stream) {
+    benchmark::DoNotOptimize(result);
+  }
+}
+
+void parseCommand(benchmark::State &state) {
+  auto input = "{ name: `Albert` } { name: `Bernard` } | { p -> p.name } | frame"s;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(makeStreamParser(env)->parse(tokenize(input)));
+  }
+}
+BENCHMARK(parseCommand);
+
+// Mostly words, e.g. long generated scripts
+void parseWords(benchmark::State &state) {
+  auto input = "git -C ~/src commit -am 'message' --no-verify HEAD 1 true"s;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(makeStreamParser(env)->parse(tokenize(input)));
+  }
+}
+BENCHMARK(parseWords);
+
+// Arithmetic over a range, evaluated on chunks
+void rangeArithmetic(benchmark::State &state) {
+  auto input = std::format("(1..{}) * 2 + 1 > 100", state.range(0));
+  for (auto _ : state) {
+    consume(makeStreamParser(env)->parse(tokenize(input)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(rangeArithmetic)->Range(1 << 4, 1 << 16);
+
+// Arithmetic on each value, evaluated in a closure
+void closureArithmetic(benchmark::State &state) {
+  auto input = std::format("1..{} | {{ i -> i * 2 + 1 }}", state.range(0));
+  for (auto _ : state) {
+    consume(makeStreamParser(env)->parse(tokenize(input)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(closureArithmetic)->Range(1 << 4, 1 << 12);
+
+// Fused builtin operators
+void builtinOperators(benchmark::State &state) {
+  auto input = std::format("1..{} | add 1 | add 2", state.range(0));
+  for (auto _ : state) {
+    consume(makeStreamParser(env)->parse(tokenize(input)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(builtinOperators)->Range(1 << 4, 1 << 12);
+
+// Builtin operators invoked by a closure for each value
+void closureBuiltins(benchmark::State &state) {
+  auto input = std::format("1..{} | {{ add 1 | add 2 }}", state.range(0));
+  for (auto _ : state) {
+    consume(makeStreamParser(env)->parse(tokenize(input)));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(closureBuiltins)->Range(1 << 4, 1 << 12);
+
+}  // namespace
@@ -0,0 +1,32 @@
+#include "stream-shell/stream_printer.h"
+
+#include <iostream>
+#include <benchmark/benchmark.h>
+#include <google/protobuf/util/json_util.h>
+
+namespace {
+
+struct NullBuffer : std::streambuf {
+  int overflow(int c) override { return c; }
+};
+
+void printRecords(benchmark::State &state) {
+  google::protobuf::Value record;
+  (void)google::protobuf::json::JsonStringToMessage(R"({ "name": "Albert", "age": 42 })", &record)
+      .ok();
+  auto values = std::vector<Result<Value>>(state.range(0), record);
+
+  // Answer the pager prompt with ":" to print all values
+  Prompt prompt = [](const char *) { return ":"; };
+
+  NullBuffer null;
+  auto *buf = std::cout.rdbuf(&null);
+  for (auto _ : state) {
+    printStream(Stream(values), prompt);
+  }
+  std::cout.rdbuf(buf);
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(printRecords)->Range(1, 1 << 12);
+
+}  // namespace
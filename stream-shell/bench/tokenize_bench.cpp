@@ -0,0 +1,37 @@
+#include "stream-shell/tokenize.h"
+
+#include <string>
+#include <benchmark/benchmark.h>
+#include <range/v3/all.hpp>
+
+using namespace std::string_literals;
+
+namespace {
+
+void tokenizeCommand(benchmark::State &state) {
+  auto input = ranges::views::repeat_n("ls -la ~/src | { f -> f.name + '.bak' } (1..10) * 2 "s,
+                                       state.range(0)) |
+               ranges::views::join | ranges::to<std::string>;
+  for (auto _ : state) {
+    size_t n = 0;
+    for (auto token : tokenize(input)) {
+      n += ranges::distance(token);
+    }
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK(tokenizeCommand)->Range(1, 1 << 8);
+
+void splitTokensCommand(benchmark::State &state) {
+  auto input = ranges::views::repeat_n("ls -la ~/src | { f -> f.name + '.bak' } (1..10) * 2 "s,
+                                       state.range(0)) |
+               ranges::views::join | ranges::to<std::string>;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(splitTokens(input));
+  }
+  state.SetBytesProcessed(state.iterations() * input.size());
+}
+BENCHMARK(splitTokensCommand)->Range(1, 1 << 8);
+
+}  // namespace
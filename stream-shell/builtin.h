@@ -3,16 +3,54 @@
 #include <cstdlib>
 #include <optional>
 #include <string_view>
+#include <vector>
 #include <range/v3/all.hpp>
 #include "builtins/add.h"
 #include "builtins/args.h"
+#include "builtins/cancel.h"
 #include "builtins/echo.h"
+#include "builtins/frame.h"
 #include "builtins/get.h"
+#include "builtins/hash.h"
+#include "builtins/merge.h"
 #include "builtins/now.h"
+#include "builtins/prefetch.h"
+#include "builtins/zip.h"
+#include "stream-shell/config.h"
+#include "stream-shell/plan.h"
 #include "stream-shell/stream_transform.h"
 
 using namespace std::string_view_literals;
 
+inline bool isBuiltinOperator(std::string_view cmd) {
+  return cmd == "add"sv || cmd == "get"sv;
+}
+
+/**
+ * Builtins transforming each input value independently, which can be fused into a Plan. The config
+ * is shared with other plans of the same command.
+ */
+inline std::optional<Operator> builtinOperator(std::string_view cmd, SharedConfig config) {
+  if (cmd == "add"sv) {
+    return [=](Value val, Batch &out) { add(std::move(val), *config, out); };
+
+  } else if (cmd == "get"sv) {
+    return [=](Value val, Batch &out) { get(std::move(val), *config, out); };
+  }
+  return {};
+}
+
+inline bool isStreamsBuiltin(std::string_view cmd) {
+  return cmd == "merge"sv || cmd == "zip"sv;
+}
+
+/**
+ * Builtins combining whole streams, which are passed as is instead of flattened into a config.
+ */
+inline Stream runStreamsBuiltin(std::string_view cmd, std::vector<Stream> inputs) {
+  return cmd == "merge"sv ? merge(std::move(inputs)) : zip(std::move(inputs));
+}
+
 inline std::optional<Stream> runBuiltin(std::string_view cmd,
                                         const google::protobuf::Struct &config,
                                         Stream input,
@@ -20,18 +58,24 @@ inline std::optional<Stream> runBuiltin(std::string_view cmd,
   if (cmd == "args"sv) {
     return args(config);
 
-  } else if (cmd == "add"sv) {
-    return std::move(input) | for_each([=](auto val) { return add(std::move(val), config); });
+  } else if (cmd == "cancel"sv) {
+    return cancel(config, env);
 
   } else if (cmd == "echo"sv) {
     return echo(config);
 
-  } else if (cmd == "get"sv) {
-    return std::move(input) | for_each([=](auto val) { return get(std::move(val), config); });
+  } else if (cmd == "frame"sv) {
+    return frame(std::move(input), config);
+
+  } else if (cmd == "hash"sv) {
+    return hash(config);
 
   } else if (cmd == "now"sv) {
     return now(env);
 
+  } else if (cmd == "prefetch"sv || cmd == "buffer"sv) {
+    return prefetch(std::move(input), config);
+
   } else if (cmd == "exit"sv) {
     return ranges::views::generate([]() -> Value { std::exit(0); });
   }
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "stream-shell/operand_op.h"
+#include "stream-shell/plan.h"
 
-inline Stream add(Value value, const google::protobuf::Struct &config) {
+inline void add(Value value, const google::protobuf::Struct &config, Batch &out) {
   if (auto it = config.fields().find("@"); it != config.fields().end()) {
     for (auto &arg : it->second.list_value().values()) {
-      return std::visit(ValueTransform(ValueOp<std::plus<>>()), std::move(value), Value(arg));
+      ranges::copy(binaryValueOp(Op::kPlus)(value, Value(arg)), ranges::back_inserter(out));
+      return;
     }
   }
-  return ranges::yield(value);
+  out.push_back(std::move(value));
 }
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string_view>
+#include <google/protobuf/struct.pb.h>
+#include "stream-shell/stream_parser.h"
+
+/**
+ * Cancels background jobs by the name of their process stream, e.g. `cancel '$1234-1'`.
+ */
+inline Stream cancel(const google::protobuf::Struct &config, Env &env) {
+  auto it = config.fields().find("@");
+  if (it == config.fields().end()) {
+    return {};
+  }
+  for (auto &arg : it->second.list_value().values()) {
+    if (!arg.has_string_value()) {
+      return ranges::yield(std::unexpected(Error::kInvalidStreamRef));
+    }
+    auto name = std::string_view(arg.string_value());
+    if (name.starts_with('$')) {
+      name.remove_prefix(1);
+    }
+    if (!env.interrupt({std::string(name)})) {
+      return ranges::yield(std::unexpected(Error::kInvalidStreamRef));
+    }
+  }
+  return {};
+}
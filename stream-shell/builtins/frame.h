@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <google/protobuf/struct.pb.h>
+#include "stream-shell/io_format.h"
+#include "stream-shell/stream_parser.h"
+
+inline auto toFraming(const google::protobuf::ListValue &args) -> std::optional<Framing> {
+  if (args.values().empty()) {
+    return Framing::kLines;
+  }
+  auto &name = args.values(0).string_value();
+  if (name == "lines") return Framing::kLines;
+  if (name == "json") return Framing::kJson;
+  if (name == "array") return Framing::kJsonArray;
+  if (name == "proto") return Framing::kDelimited;
+  return {};
+}
+
+/**
+ * Splits the bytes of the input stream into values, e.g. `cmd | frame json`, or `frame array` for
+ * the elements of a JSON array. Protobuf messages are typed using the type URL following `proto`.
+ */
+inline Stream frame(Stream input, const google::protobuf::Struct &config) {
+  google::protobuf::ListValue args;
+  if (auto it = config.fields().find("@"); it != config.fields().end()) {
+    args = it->second.list_value();
+  }
+  auto framing = toFraming(args);
+  if (!framing) {
+    return ranges::yield(std::unexpected(Error::kConfigError));
+  }
+  auto type_url = args.values().size() > 1 ? args.values(1).string_value() : std::string();
+
+  struct State {
+    Stream input;
+    std::optional<ranges::iterator_t<Stream>> it;
+    Framer framer;
+    bool eof = false;
+  };
+  auto state = std::make_shared<State>(std::move(input), std::nullopt, Framer(*framing, type_url));
+
+  return ranges::views::generate([state]() -> std::optional<Result<Value>> {
+           if (!state->it) {
+             state->it = ranges::begin(state->input);
+           }
+           for (;;) {
+             if (auto value = state->framer.next(state->eof)) {
+               return value;
+             } else if (state->eof) {
+               return std::nullopt;
+             } else if (*state->it == ranges::end(state->input)) {
+               state->eof = true;
+             } else if (auto result = **state->it; !result) {
+               ++*state->it;
+               return result;
+             } else {
+               ++*state->it;
+               if (!state->framer.append(*result)) {
+                 return std::unexpected(Error::kParseError);
+               }
+             }
+           }
+         }) |
+         ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+         ranges::views::transform([](auto &&value) { return std::move(*value); });
+}
@@ -1,12 +1,10 @@
 #pragma once
 
 #include "stream-shell/operand.h"
+#include "stream-shell/plan.h"
 
-inline auto lookupField(Value input, ranges::forward_range auto path) -> Stream {
-  if (ranges::empty(path)) {
-    return ranges::yield(input);
-  }
-  auto value = ranges::fold_left(
+inline auto findField(Value &input, ranges::forward_range auto path) -> google::protobuf::Value * {
+  return ranges::fold_left(
       path,
       std::get_if<google::protobuf::Value>(&input),
       [&](google::protobuf::Value *json, auto field) -> google::protobuf::Value * {
@@ -18,27 +16,60 @@ inline auto lookupField(Value input, ranges::forward_range auto path) -> Stream
         }
         return nullptr;
       });
+}
+
+inline void lookupField(Value input, ranges::forward_range auto path, Batch &out) {
+  if (ranges::empty(path)) {
+    out.push_back(std::move(input));
+    return;
+  }
+  auto *value = findField(input, path);
+  if (!value) {
+    // Don't treat this as error - just omit this value
+    return;
+  } else if (value->has_list_value()) {
+    for (auto &item : *value->mutable_list_value()->mutable_values()) {
+      out.push_back(std::move(item));
+    }
+    return;
+  }
+  out.push_back(std::move(*value));
+}
+
+inline auto lookupField(Value input, ranges::forward_range auto path) -> Stream {
+  if (ranges::empty(path)) {
+    return ranges::yield(input);
+  }
+  auto value = findField(input, path);
   if (!value) {
     // Don't treat this as error - just omit this value
     return Stream();
   } else if (value->has_list_value()) {
-    auto list = std::move(*value->mutable_list_value());
-    return ranges::views::iota(0, list.values().size()) |
-           ranges::views::transform([list = std::move(list)](auto i) { return list.values(i); });
+    // Items are moved out of the list as they are read, rather than copied
+    return ranges::views::generate(
+               [list = std::make_shared<google::protobuf::ListValue>(
+                    std::move(*value->mutable_list_value())),
+                i = 0] mutable -> std::optional<Result<Value>> {
+                 if (i == list->values_size()) {
+                   return std::nullopt;
+                 }
+                 return std::move(*list->mutable_values(i++));
+               }) |
+           ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+           ranges::views::transform([](auto &&value) { return std::move(*value); });
   }
   return ranges::yield(std::move(*value));
 }
 
-inline Stream get(Value value, const google::protobuf::Struct &config) {
+inline void get(Value value, const google::protobuf::Struct &config, Batch &out) {
   if (auto it = config.fields().find("@");
       it == config.fields().end() || it->second.list_value().values().size() != 1) {
-    return ranges::yield(std::unexpected(Error::kMissingOperand));
+    out.push_back(std::unexpected(Error::kMissingOperand));
 
   } else if (auto &json = it->second.list_value().values(0); !json.has_string_value()) {
-    return ranges::yield(std::unexpected(Error::kMissingOperand));
+    out.push_back(std::unexpected(Error::kMissingOperand));
 
   } else {
-    auto path = json.string_value() | ranges::views::split('.');
-    return lookupField(std::move(value), path);
+    lookupField(std::move(value), json.string_value() | ranges::views::split('.'), out);
   }
 }
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <google/protobuf/struct.pb.h>
+#include "stream-shell/executables.h"
+#include "stream-shell/stream_parser.h"
+
+/**
+ * Lists the executables resolved from $PATH, or forgets them with -r.
+ */
+inline Stream hash(const google::protobuf::Struct &config) {
+  if (auto it = config.fields().find("r"); it != config.fields().end() && it->second.bool_value()) {
+    clearExecutableCache();
+    return {};
+  }
+  return cachedExecutables() | ranges::views::transform([](auto &&path) {
+           google::protobuf::Value value;
+           value.set_string_value(std::move(path));
+           return value;
+         }) |
+         ranges::to<std::vector<Result<Value>>>;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <range/v3/all.hpp>
+#include "stream-shell/builtins/prefetch.h"
+#include "stream-shell/job.h"
+#include "stream-shell/stream_parser.h"
+
+/**
+ * Interleaves the values of streams as they become available, e.g. `merge $a $b`, until all of
+ * them end. Each stream is evaluated on its own thread, which waits while the values it produced
+ * haven't been consumed.
+ */
+inline Stream merge(std::vector<Stream> inputs) {
+  // Shared with the producer threads, which may outlive the output if detached
+  struct Shared {
+    explicit Shared(std::vector<Stream> inputs) : inputs{std::move(inputs)} {}
+
+    void produce(size_t i) {
+      for (auto &&result : inputs[i]) {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return closed || queue.size() < capacity; });
+        if (closed) {
+          break;
+        }
+        queue.push_back(std::move(result));
+        cv.notify_all();
+      }
+      // Releases the input before the producer counts as done
+      inputs[i] = {};
+      std::lock_guard lock(mutex);
+      --running;
+      done[i] = true;
+      cv.notify_all();
+    }
+
+    std::vector<Stream> inputs;
+    // Values produced by all inputs, in the order they became available
+    std::deque<Result<Value>> queue;
+    size_t capacity = Prefetcher::kDefaultCapacity;
+    size_t running = 0;
+    // Whether each producer is done with its input
+    std::vector<bool> done;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  struct State {
+    explicit State(std::vector<Stream> inputs)
+        : shared{std::make_shared<Shared>(std::move(inputs))} {}
+    ~State() {
+      std::vector<bool> done;
+      {
+        std::lock_guard lock(shared->mutex);
+        shared->closed = true;
+        done = shared->done;
+      }
+      shared->cv.notify_all();
+      // Producers still waiting for their next input value are detached, and stop once they get
+      // one, since the input may never produce it, e.g. `tail -f log`
+      for (size_t i = 0; i < producers.size(); ++i) {
+        if (done[i]) {
+          producers[i].join();
+        } else {
+          producers[i].detach();
+        }
+      }
+    }
+
+    std::optional<Result<Value>> next() {
+      if (producers.empty()) {
+        shared->running = shared->inputs.size();
+        shared->done.assign(shared->inputs.size(), false);
+        for (size_t i = 0; i < shared->inputs.size(); ++i) {
+          producers.push_back(jobThread([shared = shared, i] { shared->produce(i); }));
+        }
+      }
+      std::unique_lock lock(shared->mutex);
+      shared->cv.wait(lock, [&] { return !shared->queue.empty() || !shared->running; });
+      if (shared->queue.empty()) {
+        return std::nullopt;
+      }
+      auto result = std::move(shared->queue.front());
+      shared->queue.pop_front();
+      shared->cv.notify_all();
+      return result;
+    }
+
+    std::shared_ptr<Shared> shared;
+    std::vector<std::thread> producers;
+  };
+
+  return ranges::views::generate(
+             [state = std::make_shared<State>(std::move(inputs))] { return state->next(); }) |
+         ranges::views::take_while([](const auto &result) { return result.has_value(); }) |
+         ranges::views::transform([](auto &&result) { return std::move(*result); });
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <google/protobuf/struct.pb.h>
+#include <range/v3/all.hpp>
+#include "stream-shell/job.h"
+#include "stream-shell/spsc_queue.h"
+#include "stream-shell/stream_parser.h"
+
+/**
+ * Evaluates a stream on its own thread, up to |capacity| values ahead of the consumer. The thread
+ * stops once this is destroyed.
+ */
+class Prefetcher {
+ public:
+  static constexpr size_t kDefaultCapacity = 256;
+  static constexpr size_t kMaxCapacity = 1 << 20;
+
+  Prefetcher(Stream input, size_t capacity)
+      : _shared{std::make_shared<Shared>(std::move(input), capacity)} {}
+  ~Prefetcher() {
+    _shared->queue.close();
+    if (!_producer.joinable()) {
+      return;
+    }
+    // A producer still waiting for its next input value is detached, and stops once it gets one,
+    // since the input may never produce it, e.g. `tail -f log`
+    if (_shared->done) {
+      _producer.join();
+    } else {
+      _producer.detach();
+    }
+  }
+
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+
+  // Starts evaluating the stream, unless already started
+  void start() {
+    if (_producer.joinable()) {
+      return;
+    }
+    _producer = jobThread([shared = _shared] {
+      for (auto &&result : shared->input) {
+        if (!shared->queue.push(std::move(result))) {
+          break;
+        }
+      }
+      // Releases the input before the producer counts as done
+      shared->input = {};
+      shared->done = true;
+      shared->queue.close();
+    });
+  }
+
+  std::optional<Result<Value>> next() {
+    start();
+    return _shared->queue.pop();
+  }
+
+ private:
+  // Shared with the producer thread, which may outlive this if detached
+  struct Shared {
+    Shared(Stream input, size_t capacity) : input{std::move(input)}, queue{capacity} {}
+
+    Stream input;
+    SpscQueue<Result<Value>> queue;
+    std::atomic<bool> done = false;
+  };
+
+  std::shared_ptr<Shared> _shared;
+  std::thread _producer;
+};
+
+/**
+ * Evaluates the input stream on its own thread, up to a number of values ahead of the consumer,
+ * e.g. `cmd | prefetch 1000 | ...`, which is capped at |Prefetcher::kMaxCapacity|. The thread
+ * starts once the first value is requested, and stops once the output is released.
+ */
+inline Stream prefetch(Stream input, const google::protobuf::Struct &config) {
+  auto capacity = Prefetcher::kDefaultCapacity;
+  if (auto it = config.fields().find("@");
+      it != config.fields().end() && it->second.list_value().values_size()) {
+    auto &args = it->second.list_value();
+    auto n = args.values(0).number_value();
+    if (args.values_size() != 1 || n < 1 || n != std::trunc(n)) {
+      return ranges::yield(std::unexpected(Error::kConfigError));
+    }
+    // Slots are allocated up front
+    capacity = std::min<double>(n, Prefetcher::kMaxCapacity);
+  }
+
+  return ranges::views::generate(
+             [prefetcher = std::make_shared<Prefetcher>(std::move(input), capacity)] {
+               return prefetcher->next();
+             }) |
+         ranges::views::take_while([](const auto &result) { return result.has_value(); }) |
+         ranges::views::transform([](auto &&result) { return std::move(*result); });
+}
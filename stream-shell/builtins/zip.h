@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <range/v3/all.hpp>
+#include "stream-shell/builtins/prefetch.h"
+#include "stream-shell/stream_parser.h"
+
+/**
+ * Pairs up the values of streams into lists, e.g. `zip (cmd a) (cmd b)`, until either stream ends
+ * or yields an error.
+ * Each stream is evaluated on its own thread, so that slow streams are waited for concurrently.
+ * Bytes are paired up as strings, while strongly typed values can't be put in a list.
+ */
+inline Stream zip(std::vector<Stream> inputs) {
+  if (inputs.empty()) {
+    return {};
+  }
+  auto prefetchers = std::make_shared<std::vector<std::unique_ptr<Prefetcher>>>();
+  for (auto &input : inputs) {
+    prefetchers->push_back(
+        std::make_unique<Prefetcher>(std::move(input), Prefetcher::kDefaultCapacity));
+  }
+
+  return ranges::views::generate([prefetchers]() -> std::optional<Result<Value>> {
+           // Released once an input yielded an error
+           if (prefetchers->empty()) {
+             return std::nullopt;
+           }
+           for (auto &prefetcher : *prefetchers) {
+             prefetcher->start();
+           }
+           google::protobuf::Value value;
+           auto &list = *value.mutable_list_value();
+           for (auto &prefetcher : *prefetchers) {
+             auto result = prefetcher->next();
+             if (!result) {
+               return result;
+             } else if (!*result) {
+               // Ends the zip, since values already taken from other inputs would be misaligned
+               prefetchers->clear();
+               return result;
+             } else if (auto *item = std::get_if<google::protobuf::Value>(&**result)) {
+               *list.add_values() = std::move(*item);
+             } else if (auto *i = std::get_if<google::protobuf::Int64Value>(&**result)) {
+               list.add_values()->set_number_value(i->value());
+             } else if (auto *bytes = std::get_if<google::protobuf::BytesValue>(&**result)) {
+               list.add_values()->set_string_value(std::move(*bytes->mutable_value()));
+             } else {
+               prefetchers->clear();
+               return std::unexpected(Error::kInvalidOp);
+             }
+           }
+           return value;
+         }) |
+         ranges::views::take_while([](const auto &result) { return result.has_value(); }) |
+         ranges::views::transform([](auto &&result) { return std::move(*result); });
+}
@@ -0,0 +1,284 @@
+#include "child_process.h"
+
+#include <atomic>
+#include <csignal>
+#include <memory>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <range/v3/all.hpp>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include "config.h"
+#include "io_format.h"
+#include "job.h"
+#include "process_stream.h"
+
+#if !__EMSCRIPTEN__
+
+namespace {
+
+inline auto exec(std::string cmd, std::vector<std::string> args) {
+  if (cmd.starts_with('^')) {
+    cmd.erase(cmd.begin());
+  }
+  auto argv =
+      ranges::views::concat(ranges::views::single(cmd.data()),
+                            args | ranges::views::transform([](auto &s) { return s.data(); }),
+                            ranges::views::single(nullptr)) |
+      ranges::to<std::vector>;
+  return execvp(cmd.data(), argv.data());
+}
+
+/**
+ * Opens a pipe that is not leaked into other spawned children. Without pipe2, e.g. on macOS, a
+ * child forked concurrently may still inherit it before it's marked close-on-exec.
+ */
+bool makePipe(int fds[2]) {
+#if __linux__ || __FreeBSD__ || __NetBSD__ || __OpenBSD__
+  return pipe2(fds, O_CLOEXEC) == 0;
+#else
+  if (pipe(fds) < 0) {
+    return false;
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  return true;
+#endif
+}
+
+bool writeAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    auto n = ::write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+/**
+ * Owns a spawned child process and the thread feeding the input stream to its stdin. The child is
+ * terminated if the output stream is dropped before it has been fully read.
+ */
+struct ChildProcess {
+  ChildProcess(pid_t pid, int out_fd, ExecMode mode, Env &env)
+      : pid{pid}, out_fd{out_fd}, mode{mode}, env{env} {}
+  ~ChildProcess() {
+    if (out_fd >= 0) {
+      env.close(out_fd);
+    }
+    if (pid > 0) {
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+    }
+    stopWriter();
+  }
+
+  /**
+   * Serializes the input stream to |in_fd| on a separate thread, so that reading stdout is not
+   * blocked by a child waiting for input. Back-pressure is kept by the bounded pipe buffer.
+   */
+  void write(int in_fd, Stream input) {
+    writer = jobThread([in_fd, input = std::move(input), state = writer_state]() mutable {
+      std::string buffer;
+      for (auto &&result : input) {
+        buffer.clear();
+        if (state->stop || !result || !serialize(*result, buffer) || !writeAll(in_fd, buffer)) {
+          break;
+        }
+      }
+      // Releases the upstream pipeline before the child sees the end of its input
+      input = {};
+      state->done = true;
+      close(in_fd);
+    });
+  }
+
+  /**
+   * Stops the stdin writer once the child is gone. A writer still waiting for the next input value
+   * is detached, and stops once it gets one, since the upstream may never produce it, e.g. with
+   * `tail -f log | head -n 1`.
+   */
+  void stopWriter() {
+    if (!writer.joinable()) {
+      return;
+    }
+    writer_state->stop = true;
+    if (writer_state->done) {
+      writer.join();
+    } else {
+      writer.detach();
+    }
+  }
+
+  /**
+   * Reaps the child process, returning its exit status.
+   */
+  int wait() {
+    env.close(std::exchange(out_fd, -1));
+    int status = 0;
+    waitpid(std::exchange(pid, -1), &status, 0);
+    if (mode == ExecMode::kTerminal) {
+      tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    stopWriter();
+    return status;
+  }
+
+  pid_t pid;
+  int out_fd;
+  ExecMode mode;
+  Env &env;
+
+  // Shared with the writer thread, which may outlive the child if detached
+  struct WriterState {
+    std::atomic<bool> stop = false;
+    std::atomic<bool> done = false;
+  };
+  std::shared_ptr<WriterState> writer_state = std::make_shared<WriterState>();
+  std::thread writer;
+};
+
+auto spawnTerminal(std::string_view cmd,
+                   const google::protobuf::Struct &config,
+                   int in_fd,
+                   Env &env) -> Result<std::shared_ptr<ChildProcess>> {
+  auto pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (pty_fd < 0 || grantpt(pty_fd) < 0 || unlockpt(pty_fd) < 0) {
+    return std::unexpected(Error::kExecPipeError);
+  }
+
+  const char *tty_name = ptsname(pty_fd);
+  if (!tty_name) {
+    close(pty_fd);
+    return std::unexpected(Error::kExecPipeError);
+  }
+  fcntl(pty_fd, F_SETFD, FD_CLOEXEC);
+
+  if (auto pid = fork(); pid == 0) {
+    // Child process
+    int tty_fd = open(tty_name, O_RDWR);
+    if (tty_fd < 0) _exit(1);
+
+    if (setsid() == -1 || ioctl(tty_fd, TIOCSCTTY, 0) == -1 ||
+        tcsetpgrp(tty_fd, getpid()) == -1) {
+      close(tty_fd);
+      _exit(1);
+    }
+
+    dup2(in_fd >= 0 ? in_fd : tty_fd, STDIN_FILENO);
+    dup2(tty_fd, STDOUT_FILENO);
+    dup2(tty_fd, STDERR_FILENO);
+
+    close(pty_fd);
+    close(tty_fd);
+
+    // The shell ignores SIGPIPE for the stdin writer, but the child should not inherit that
+    signal(SIGPIPE, SIG_DFL);
+
+    exec(std::string(cmd), toArgs(config));
+    _exit(1);
+
+  } else if (pid > 0) {
+    // Parent process
+    tcsetpgrp(pty_fd, pid);
+    return std::make_shared<ChildProcess>(pid, pty_fd, ExecMode::kTerminal, env);
+  }
+  close(pty_fd);
+  return std::unexpected(Error::kExecForkError);
+}
+
+auto spawnPipe(std::string_view cmd, const google::protobuf::Struct &config, int in_fd, Env &env)
+    -> Result<std::shared_ptr<ChildProcess>> {
+  int out_fds[2];
+  if (!makePipe(out_fds)) {
+    return std::unexpected(Error::kExecPipeError);
+  }
+
+  if (auto pid = fork(); pid == 0) {
+    // Child process
+    if (in_fd >= 0) {
+      dup2(in_fd, STDIN_FILENO);
+    }
+    dup2(out_fds[1], STDOUT_FILENO);
+
+    signal(SIGPIPE, SIG_DFL);
+
+    exec(std::string(cmd), toArgs(config));
+    _exit(1);
+
+  } else if (pid > 0) {
+    // Parent process
+    close(out_fds[1]);
+    return std::make_shared<ChildProcess>(pid, out_fds[0], ExecMode::kPipe, env);
+  }
+  close(out_fds[0]);
+  close(out_fds[1]);
+  return std::unexpected(Error::kExecForkError);
+}
+
+}  // namespace
+
+#endif
+
+Stream runChildProcess(std::string_view cmd,
+                       const google::protobuf::Struct &config,
+                       ExecMode mode,
+                       bool has_input,
+                       Stream input,
+                       Env &env) {
+#if !__EMSCRIPTEN__
+  // Input from another stage is written to a pipe, otherwise stdin is inherited
+  int in_fds[2] = {-1, -1};
+  if (has_input && !makePipe(in_fds)) {
+    return ranges::yield(std::unexpected(Error::kExecPipeError));
+  }
+
+  auto child = mode == ExecMode::kTerminal ? spawnTerminal(cmd, config, in_fds[0], env)
+                                           : spawnPipe(cmd, config, in_fds[0], env);
+  if (has_input) {
+    close(in_fds[0]);
+    if (child) {
+      (*child)->write(in_fds[1], std::move(input));
+    } else {
+      close(in_fds[1]);
+    }
+  }
+  if (!child) {
+    return ranges::yield(std::unexpected(child.error()));
+  }
+
+  // Mirrored to $<PID> while the output is read
+  auto output = env.processStream(std::to_string((*child)->pid));
+
+  return ranges::views::generate(
+             [&env,
+              child = std::move(*child),
+              output = std::move(output),
+              bytes = google::protobuf::BytesValue()] mutable -> std::optional<Result<Value>> {
+               if (auto n = env.read(child->out_fd, bytes); n == 0) {
+                 if (child->wait() != 0) {
+                   output->publish(std::unexpected(Error::kExecNonZeroStatus));
+                   return std::unexpected(Error::kExecNonZeroStatus);
+                 }
+                 return std::nullopt;
+               } else if (n < 0) {
+                 return std::unexpected(Error::kExecReadError);
+               } else {
+                 output->publish(bytes);
+                 return bytes;
+               }
+             }) |
+         ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+         ranges::views::transform([](auto &&value) { return std::move(*value); });
+#else
+  return ranges::yield(std::unexpected(Error::kExecError));
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string_view>
+#include <google/protobuf/struct.pb.h>
+#include "stream_parser.h"
+
+enum class ExecMode {
+  // Runs in a pseudo-terminal, for commands printing directly to the terminal
+  kTerminal,
+  // Runs with stdout connected to a pipe, for commands consumed by another stage
+  kPipe,
+};
+
+/**
+ * Spawns an executable binary, reading its stdout as a stream of bytes. If |has_input| is set, the
+ * input stream is serialized to stdin using the I/O Format, otherwise stdin is inherited.
+ */
+Stream runChildProcess(std::string_view cmd,
+                       const google::protobuf::Struct &config,
+                       ExecMode mode,
+                       bool has_input,
+                       Stream input,
+                       Env &env);
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <google/protobuf/struct.pb.h>
+#include <google/protobuf/wrappers.pb.h>
+#include <range/v3/all.hpp>
+#include "stream_parser.h"
+
+inline google::protobuf::Int64Value makeInt(int64_t i) {
+  google::protobuf::Int64Value value;
+  value.set_value(i);
+  return value;
+}
+
+/**
+ * Converts an integer to a JSON number where it becomes part of one, e.g. a record or a config.
+ */
+inline google::protobuf::Value toNumber(const google::protobuf::Int64Value &i) {
+  google::protobuf::Value value;
+  value.set_number_value(i.value());
+  return value;
+}
+
+/**
+ * |value| as an integer, if it's an integral number in range.
+ */
+inline std::optional<int64_t> toInt(const google::protobuf::Value &value) {
+  if (auto n = value.number_value();
+      value.has_number_value() && n == std::trunc(n) && n >= -0x1p63 && n < 0x1p63) {
+    return int64_t(n);
+  }
+  return {};
+}
+
+/**
+ * Bound of a range, where numbers are truncated, if it's in range.
+ */
+inline std::optional<int64_t> rangeBound(const google::protobuf::Value &value) {
+  if (auto n = std::trunc(value.number_value());
+      value.has_number_value() && n >= -0x1p63 && n < 0x1p63) {
+    return int64_t(n);
+  }
+  return {};
+}
+inline std::optional<int64_t> rangeBound(const google::protobuf::Int64Value &value) {
+  return value.value();
+}
+
+/**
+ * Columnar batch of primitives, used to evaluate numeric streams without allocating a Value per
+ * element. Integers are kept exact, bools are stored as 0 or 1, and elements missing from the
+ * validity mask are null.
+ */
+struct Chunk {
+  static constexpr size_t kMaxSize = 4096;
+
+  enum class Kind { kNumber, kInt, kBool };
+
+  Kind kind = Kind::kNumber;
+  std::vector<double> values;
+  // Used instead of |values| by integer chunks
+  std::vector<int64_t> ints;
+  // Empty if all values are valid
+  std::vector<uint8_t> valid;
+  // A single value broadcast against the other operand of a binary operation
+  bool scalar = false;
+
+  size_t size() const { return kind == Kind::kInt ? ints.size() : values.size(); }
+  bool isValid(size_t i) const { return valid.empty() || valid[i]; }
+
+  Value at(size_t i) const {
+    google::protobuf::Value value;
+    if (!isValid(i)) {
+      value.set_null_value({});
+    } else if (kind == Kind::kInt) {
+      return makeInt(ints[i]);
+    } else if (kind == Kind::kBool) {
+      value.set_bool_value(values[i]);
+    } else {
+      value.set_number_value(values[i]);
+    }
+    return value;
+  }
+
+  // Integers as doubles, for operations that aren't exact on integers or mix them with numbers
+  Chunk toNumbers() const {
+    return {.values = ints | ranges::to<std::vector<double>>, .valid = valid, .scalar = scalar};
+  }
+
+  static std::optional<Chunk> fromScalar(const google::protobuf::Int64Value &value) {
+    return Chunk{.kind = Kind::kInt, .ints = {value.value()}, .scalar = true};
+  }
+  static std::optional<Chunk> fromScalar(const google::protobuf::Value &value) {
+    if (auto i = toInt(value)) {
+      // Integral numbers are broadcast as integers, keeping integer chunks exact
+      return fromScalar(makeInt(*i));
+    } else if (value.has_number_value()) {
+      return Chunk{.kind = Kind::kNumber, .values = {value.number_value()}, .scalar = true};
+    } else if (value.has_bool_value()) {
+      return Chunk{.kind = Kind::kBool, .values = {double(value.bool_value())}, .scalar = true};
+    }
+    return {};
+  }
+};
+
+using ChunkStream = ranges::any_view<Result<Chunk>>;
+
+/**
+ * Expands chunks into a stream of Values, for stages that don't operate on chunks.
+ */
+inline Stream unchunk(ChunkStream chunks) {
+  return std::move(chunks) | ranges::views::for_each([](Result<Chunk> result) -> Stream {
+           if (!result) {
+             return ranges::yield(std::unexpected(result.error()));
+           }
+           return ranges::views::iota(size_t(0), result->size()) |
+                  ranges::views::transform([chunk = std::move(*result)](size_t i) -> Result<Value> {
+                    return chunk.at(i);
+                  });
+         });
+}
+
+/**
+ * Numeric range from |from| to |to| (inclusive), or unbounded.
+ */
+inline ChunkStream iotaChunks(int64_t from, std::optional<int64_t> to = {}) {
+  auto to_chunk = ranges::views::transform([](auto &&ints) -> Result<Chunk> {
+    return Chunk{.kind = Chunk::Kind::kInt, .ints = ints | ranges::to<std::vector<int64_t>>};
+  });
+  // Closed, so that the largest integer can be included
+  auto last = to.value_or(std::numeric_limits<int64_t>::max());
+  if (last < from) {
+    return {};
+  }
+  return ranges::views::closed_iota(from, last) | ranges::views::chunk(Chunk::kMaxSize) |
+         to_chunk;
+}
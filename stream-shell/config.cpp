@@ -1,7 +1,12 @@
 #include "config.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string_view>
 #include <variant>
 #include <google/protobuf/any.pb.h>
+#include <google/protobuf/arena.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/dynamic_message.h>
 #include <google/protobuf/struct.pb.h>
@@ -13,14 +18,50 @@
 
 namespace {
 
+/**
+ * Scratch messages for building a config. These are allocated on an arena, so that intermediate
+ * records and subcommand structs are released in bulk once the config has been copied out.
+ */
 struct Buffer {
-  google::protobuf::Struct json;
-  std::deque<google::protobuf::Any> record = {google::protobuf::Any()};
+  explicit Buffer(google::protobuf::Arena *arena) : arena{arena} {}
 
-  google::protobuf::Struct *merge_target = &json;
-  google::protobuf::ListValue *positionals = (*json.mutable_fields())["@"].mutable_list_value();
+  google::protobuf::Any *newRecord() {
+    return google::protobuf::Arena::Create<google::protobuf::Any>(arena);
+  }
+
+  google::protobuf::Arena *arena;
+
+  google::protobuf::Struct *json = google::protobuf::Arena::Create<google::protobuf::Struct>(arena);
+  std::vector<google::protobuf::Any *> record = {newRecord()};
+
+  google::protobuf::Struct *merge_target = json;
+  google::protobuf::ListValue *positionals = (*json->mutable_fields())["@"].mutable_list_value();
 };
 
+bool isPlainChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || std::string_view("-_./:@+, ").contains(c);
+}
+
+/**
+ * Serializes |val| as JSON, formatting common primitives directly rather than with the JSON
+ * printer, which is comparatively slow.
+ */
+bool toJson(const google::protobuf::Value &val, std::string &json) {
+  if (val.has_bool_value()) {
+    json = val.bool_value() ? "true" : "false";
+    return true;
+  } else if (auto n = val.number_value(); val.has_number_value() && std::abs(n) < 1e15 &&
+                                           n == std::trunc(n) && (n || !std::signbit(n))) {
+    json = std::to_string(int64_t(n));
+    return true;
+  } else if (val.has_string_value() && std::ranges::all_of(val.string_value(), isPlainChar)) {
+    json = '"' + val.string_value() + '"';
+    return true;
+  }
+  json.clear();
+  return google::protobuf::json::MessageToJsonString(val, &json).ok();
+}
+
 bool merge(Env &, Buffer &buffer, const google::protobuf::BytesValue &bytes) {
   auto *arg = buffer.positionals->add_values()->mutable_string_value();
   return google::protobuf::json::MessageToJsonString(bytes, arg).ok();
@@ -32,9 +73,9 @@ bool merge(Env &, Buffer &buffer, const google::protobuf::Value &val) {
 
   } else {
     *buffer.positionals->add_values() = val;
-    buffer.record.emplace_back();
+    buffer.record.push_back(buffer.newRecord());
     std::string subcommand;
-    if (!google::protobuf::json::MessageToJsonString(val, &subcommand).ok()) {
+    if (!toJson(val, subcommand)) {
       return false;
     }
     buffer.merge_target =
@@ -43,14 +84,19 @@ bool merge(Env &, Buffer &buffer, const google::protobuf::Value &val) {
   return true;
 }
 
+bool merge(Env &env, Buffer &buffer, const google::protobuf::Int64Value &i) {
+  return merge(env, buffer, toNumber(i));
+}
+
 bool merge(Env &, Buffer &buffer, const google::protobuf::Any &any) {
-  if (buffer.record.back().type_url().empty()) {
-    buffer.record.back().set_type_url(any.type_url());
+  auto *record = buffer.record.back();
+  if (record->type_url().empty()) {
+    record->set_type_url(any.type_url());
   }
-  if (buffer.record.back().type_url() != any.type_url()) {
+  if (record->type_url() != any.type_url()) {
     return false;
   }
-  buffer.record.back().mutable_value()->append_range(any.value());
+  record->mutable_value()->append_range(any.value());
   return true;
 }
 
@@ -66,21 +112,32 @@ bool merge(Env &env, Buffer &buffer, const Stream &stream) {
       .value_or(false);
 }
 
+bool merge(Env &env, Buffer &buffer, const ChunkStream &chunks) {
+  return merge(env, buffer, unchunk(chunks));
+}
+
 bool merge(Env &env, Buffer &buffer, const StreamRef &ref) {
   auto f = env.getEnv(ref);
   return f && merge(env, buffer, f({}));
 }
 
-auto to_string(auto value) {
+auto to_string(const google::protobuf::Value &value) {
   std::string arg;
-  assert(google::protobuf::util::MessageToJsonString(value, &arg).ok());
+  (void)toJson(value, arg);
   return arg;
 }
 
 }  // namespace
 
 Result<google::protobuf::Struct> toConfig(Env &env, std::span<const Operand> operands) {
-  Buffer buffer;
+  // Most configs fit in the initial block, avoiding the heap until the result is copied out
+  alignas(8) char initial_block[4096];
+  google::protobuf::ArenaOptions options;
+  options.initial_block = initial_block;
+  options.initial_block_size = sizeof(initial_block);
+  google::protobuf::Arena arena(options);
+
+  Buffer buffer(&arena);
 
   for (const Operand &op : operands) {
     if (auto ok = std::visit([&](auto &op) { return merge(env, buffer, op); }, op); !ok) {
@@ -88,26 +145,26 @@ Result<google::protobuf::Struct> toConfig(Env &env, std::span<const Operand> ope
     }
   }
 
-  for (buffer.merge_target = &buffer.json; const auto &[cmd, record] : ranges::views::zip(
-                                               buffer.positionals->values(), buffer.record)) {
+  for (buffer.merge_target = buffer.json; const auto &[cmd, record] : ranges::views::zip(
+                                              buffer.positionals->values(), buffer.record)) {
     std::string json;
-    if (!google::protobuf::json::MessageToJsonString(cmd, &json).ok()) {
+    if (!toJson(cmd, json)) {
       return std::unexpected(Error::kConfigError);
     }
 
     buffer.merge_target = (*buffer.merge_target->mutable_fields())[json].mutable_struct_value();
 
-    if (!record.type_url().empty()) {
-      if (!google::protobuf::json::MessageToJsonString(record, &json).ok()) {
+    if (!record->type_url().empty()) {
+      if (!google::protobuf::json::MessageToJsonString(*record, &json).ok()) {
         return std::unexpected(Error::kConfigError);
       }
-      if (!google::protobuf::json::JsonStringToMessage(json, &buffer.json).ok()) {
+      if (!google::protobuf::json::JsonStringToMessage(json, buffer.json).ok()) {
         return std::unexpected(Error::kConfigError);
       }
     }
   }
 
-  return buffer.json;
+  return *buffer.json;
 }
 
 std::vector<std::string> toArgs(const google::protobuf::Struct &config) {
@@ -130,3 +187,26 @@ std::vector<std::string> toArgs(const google::protobuf::Struct &config) {
   }
   return args;
 }
+
+CommandConfig::CommandConfig(Env &env, std::vector<Operand> operands) : _env{&env} {
+  auto constant = std::ranges::all_of(operands, [](const Operand &op) {
+    return !std::holds_alternative<Stream>(op) && !std::holds_alternative<ChunkStream>(op) &&
+           !std::holds_alternative<StreamRef>(op);
+  });
+  if (!constant) {
+    _operands = std::move(operands);
+    return;
+  }
+  _constant = toConfig(env, operands).transform([](auto &&config) -> SharedConfig {
+    return std::make_shared<const google::protobuf::Struct>(std::move(config));
+  });
+}
+
+Result<SharedConfig> CommandConfig::operator()() const {
+  if (_constant) {
+    return *_constant;
+  }
+  return toConfig(*_env, _operands).transform([](auto &&config) -> SharedConfig {
+    return std::make_shared<const google::protobuf::Struct>(std::move(config));
+  });
+}
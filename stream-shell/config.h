@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
 #include <vector>
@@ -9,4 +11,23 @@
 
 Result<google::protobuf::Struct> toConfig(Env &, std::span<const Operand>);
 
+using SharedConfig = std::shared_ptr<const google::protobuf::Struct>;
+
+/**
+ * Config of a command, built once up front if its operands are all values, or else on each call,
+ * since streams and stream refs may depend on closure variables or the environment.
+ */
+class CommandConfig {
+ public:
+  CommandConfig(Env &env, std::vector<Operand> operands);
+
+  Result<SharedConfig> operator()() const;
+
+ private:
+  Env *_env;
+  // Empty if constant
+  std::vector<Operand> _operands;
+  std::optional<Result<SharedConfig>> _constant;
+};
+
 std::vector<std::string> toArgs(const google::protobuf::Struct &config);
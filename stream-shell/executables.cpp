@@ -0,0 +1,124 @@
+#include "executables.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unistd.h>
+
+namespace {
+
+bool isExecutable(const std::filesystem::path &p) {
+  std::error_code ec;
+  return std::filesystem::is_regular_file(p, ec) && access(p.c_str(), X_OK) == 0;
+}
+
+auto modifiedTime(const std::filesystem::path &dir) {
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(dir, ec);
+  return ec ? std::filesystem::file_time_type::min() : mtime;
+}
+
+/**
+ * Resolved executables by name. Instead of checking each directory of $PATH per lookup, the
+ * directories are checked for modifications (e.g. an installed binary) at most once per interval.
+ */
+struct ExecutableCache {
+  static constexpr auto kValidateInterval = std::chrono::seconds(1);
+
+  struct Dir {
+    std::filesystem::path path;
+    std::filesystem::file_time_type mtime;
+  };
+
+  bool find(std::string_view cmd) {
+    std::lock_guard lock(_mutex);
+    validate();
+
+    auto it = _executables.find(cmd);
+    if (it == _executables.end()) {
+      it = _executables.emplace(cmd, std::nullopt).first;
+      for (auto &dir : _dirs) {
+        if (auto path = dir.path / cmd; isExecutable(path)) {
+          it->second = path.string();
+          break;
+        }
+      }
+    }
+    return it->second.has_value();
+  }
+
+  std::vector<std::string> paths() {
+    std::lock_guard lock(_mutex);
+    std::vector<std::string> paths;
+    for (auto &[name, path] : _executables) {
+      if (path) paths.push_back(*path);
+    }
+    return paths;
+  }
+
+  void clear() {
+    std::lock_guard lock(_mutex);
+    _path.reset();
+  }
+
+ private:
+  void validate() {
+    auto *path_env = std::getenv("PATH");
+    auto path = std::string_view(path_env ? path_env : "");
+    auto now = std::chrono::steady_clock::now();
+
+    if (!_path || *_path != path) {
+      _path = path;
+      _dirs.clear();
+      for (size_t begin = 0, end = 0; begin < path.size(); begin = end + 1) {
+        end = std::min(path.find(':', begin), path.size());
+        auto dir = std::filesystem::path(path.substr(begin, end - begin));
+        _dirs.push_back({.path = dir, .mtime = modifiedTime(dir)});
+      }
+      _executables.clear();
+
+    } else if (now >= _validated + kValidateInterval) {
+      for (auto &dir : _dirs) {
+        if (auto mtime = modifiedTime(dir.path); mtime != dir.mtime) {
+          dir.mtime = mtime;
+          _executables.clear();
+        }
+      }
+    } else {
+      return;
+    }
+    _validated = now;
+  }
+
+  std::mutex _mutex;
+  std::optional<std::string> _path;
+  std::vector<Dir> _dirs;
+  std::chrono::steady_clock::time_point _validated;
+  std::map<std::string, std::optional<std::string>, std::less<>> _executables;
+};
+
+ExecutableCache &executableCache() {
+  static ExecutableCache cache;
+  return cache;
+}
+
+}  // namespace
+
+bool isExecutableInPath(std::string_view cmd) {
+  if (cmd.contains('/')) {
+    return isExecutable(cmd);
+  }
+  return executableCache().find(cmd);
+}
+
+std::vector<std::string> cachedExecutables() {
+  return executableCache().paths();
+}
+
+void clearExecutableCache() {
+  executableCache().clear();
+}
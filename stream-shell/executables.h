@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Whether |cmd| is an executable file, either by path or by name in a directory of $PATH. Lookups
+ * by name are cached until $PATH changes, a directory in it is modified, or the cache is cleared.
+ */
+bool isExecutableInPath(std::string_view cmd);
+
+/**
+ * Paths of the executables currently in the cache.
+ */
+std::vector<std::string> cachedExecutables();
+
+/**
+ * Forgets all cached lookups, like `hash -r` in POSIX shells.
+ */
+void clearExecutableCache();
@@ -0,0 +1,154 @@
+#include "io_format.h"
+
+#include <variant>
+#include <google/protobuf/any.pb.h>
+#include <google/protobuf/struct.pb.h>
+#include <google/protobuf/util/json_util.h>
+#include <google/protobuf/wrappers.pb.h>
+
+namespace {
+
+void appendVarint(uint64_t n, std::string &out) {
+  for (; n >= 0x80; n >>= 7) {
+    out.push_back(char(n | 0x80));
+  }
+  out.push_back(char(n));
+}
+
+bool serialize(const google::protobuf::BytesValue &bytes, std::string &out) {
+  out += bytes.value();
+  return true;
+}
+
+bool serialize(const google::protobuf::Value &value, std::string &out) {
+  if (value.has_string_value()) {
+    out += value.string_value();
+  } else if (std::string json; google::protobuf::json::MessageToJsonString(value, &json).ok()) {
+    out += json;
+  } else {
+    return false;
+  }
+  out.push_back('\n');
+  return true;
+}
+
+bool serialize(const google::protobuf::Int64Value &i, std::string &out) {
+  out += std::to_string(i.value());
+  out.push_back('\n');
+  return true;
+}
+
+bool serialize(const google::protobuf::Any &any, std::string &out) {
+  appendVarint(any.value().size(), out);
+  out += any.value();
+  return true;
+}
+
+}  // namespace
+
+bool serialize(const Value &value, std::string &out) {
+  return std::visit([&](auto &value) { return serialize(value, out); }, value);
+}
+
+bool Framer::append(const Value &value) {
+  auto consumed = std::exchange(_offset, 0);
+  _buffer.erase(0, consumed);
+  if (_json) {
+    _json->drop(consumed);
+  }
+  return serialize(value, _buffer);
+}
+
+auto Framer::next(bool eof) -> std::optional<Result<Value>> {
+  switch (_framing) {
+    case Framing::kLines:
+      if (auto line = nextLine(eof)) {
+        google::protobuf::Value value;
+        value.set_string_value(*line);
+        return value;
+      }
+      break;
+
+    case Framing::kJson:
+    case Framing::kJsonArray:
+      return nextJson(eof);
+
+    case Framing::kDelimited:
+      return nextMessage(eof);
+  }
+  return std::nullopt;
+}
+
+auto Framer::nextLine(bool eof) -> std::optional<std::string_view> {
+  auto pending = std::string_view(_buffer).substr(_offset);
+  auto n = pending.find('\n');
+  if (n == std::string_view::npos) {
+    if (!eof || pending.empty()) {
+      return std::nullopt;
+    }
+    n = pending.size();
+  }
+  _offset += std::min(n + 1, pending.size());
+
+  auto line = pending.substr(0, n);
+  if (line.ends_with('\r')) {
+    line.remove_suffix(1);
+  }
+  return line;
+}
+
+auto Framer::nextJson(bool eof) -> std::optional<Result<Value>> {
+  auto scan = _json->next(_buffer, eof);
+  _offset = _json->consumed();
+
+  switch (scan.status) {
+    case JsonScanner::Status::kPending:
+      return std::nullopt;
+    case JsonScanner::Status::kError:
+      return std::unexpected(Error::kJsonError);
+    case JsonScanner::Status::kValue:
+      break;
+  }
+  google::protobuf::Value value;
+  auto json = std::string_view(_buffer).substr(scan.begin, scan.end - scan.begin);
+  if (!google::protobuf::json::JsonStringToMessage(json, &value).ok()) {
+    return std::unexpected(Error::kJsonError);
+  }
+  return value;
+}
+
+auto Framer::nextMessage(bool eof) -> std::optional<Result<Value>> {
+  auto pending = std::string_view(_buffer).substr(_offset);
+  auto truncated = [&]() -> std::optional<Result<Value>> {
+    if (!eof || pending.empty()) {
+      return std::nullopt;
+    }
+    _offset = _buffer.size();
+    return std::unexpected(Error::kParseError);
+  };
+
+  uint64_t size = 0;
+  size_t i = 0;
+  for (int shift = 0;; shift += 7) {
+    if (i == pending.size()) {
+      return truncated();
+    } else if (shift > 63) {
+      _offset = _buffer.size();
+      return std::unexpected(Error::kParseError);
+    }
+    auto byte = uint8_t(pending[i++]);
+    size |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      break;
+    }
+  }
+  if (pending.size() - i < size) {
+    return truncated();
+  }
+  _offset += i + size;
+
+  google::protobuf::Any any;
+  any.set_type_url(_type_url);
+  any.set_value(pending.substr(i, size));
+  return any;
+}
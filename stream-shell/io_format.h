@@ -0,0 +1,56 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include "json_scanner.h"
+#include "stream_parser.h"
+
+/**
+ * Appends a value encoded in the I/O Format, as written to the stdin of a child process.
+ */
+bool serialize(const Value &, std::string &out);
+
+enum class Framing {
+  // One string value per line
+  kLines,
+  // One value per JSON value, e.g. per line of NDJSON
+  kJson,
+  // Like |kJson|, but one value per element of top-level arrays, which are never held in full
+  kJsonArray,
+  // One record per varint-delimited protobuf message
+  kDelimited,
+};
+
+/**
+ * Incrementally splits a byte stream, such as the stdout of a child process, into values. Bytes are
+ * kept in a single buffer that is compacted as complete values are taken from it.
+ */
+struct Framer {
+  explicit Framer(Framing framing, std::string type_url = {})
+      : _framing{framing}, _type_url{std::move(type_url)} {
+    if (framing == Framing::kJson || framing == Framing::kJsonArray) {
+      _json.emplace(framing == Framing::kJsonArray);
+    }
+  }
+
+  /**
+   * Appends the I/O Format encoding of a value, e.g. raw bytes from a chunk of stdout.
+   */
+  bool append(const Value &);
+
+  /**
+   * Takes the next complete value, if any. Once |eof| is set, trailing bytes are flushed.
+   */
+  auto next(bool eof = false) -> std::optional<Result<Value>>;
+
+ private:
+  auto nextLine(bool eof) -> std::optional<std::string_view>;
+  auto nextJson(bool eof) -> std::optional<Result<Value>>;
+  auto nextMessage(bool eof) -> std::optional<Result<Value>>;
+
+  Framing _framing;
+  std::string _type_url;
+  std::optional<JsonScanner> _json;
+  std::string _buffer;
+  size_t _offset = 0;
+};
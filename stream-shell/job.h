@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <utility>
+
+/**
+ * A pipeline being evaluated, which the blocking calls of every thread evaluating it check to stop
+ * when it's interrupted or cancelled.
+ */
+struct Job {
+  // Guarded by the Env interrupting the job
+  bool stop = false;
+};
+
+/**
+ * The job evaluated by the calling thread, if any.
+ */
+inline thread_local std::shared_ptr<Job> t_job;
+
+/**
+ * Wraps |task| to run on behalf of the calling thread's job, e.g. on another thread, so that it's
+ * stopped along with the job rather than with whatever job that thread evaluates otherwise.
+ */
+template <typename F>
+auto withJob(F task) {
+  return [job = t_job, task = std::move(task)]() mutable {
+    auto previous = std::exchange(t_job, job);
+    task();
+    t_job = std::move(previous);
+  };
+}
+
+/**
+ * Starts a thread helping to evaluate the calling thread's job.
+ */
+template <typename F>
+std::thread jobThread(F task) {
+  return std::thread(withJob(std::move(task)));
+}
@@ -0,0 +1,182 @@
+#include "json_scanner.h"
+
+namespace {
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Characters of numbers, true, false and null, which are validated when the value is parsed
+bool isLiteral(char c) {
+  return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '+' || c == '-' ||
+         c == '.';
+}
+
+}  // namespace
+
+auto JsonScanner::next(std::string_view input, bool eof) -> Scan {
+  while (_pos < input.size()) {
+    auto c = input[_pos];
+    switch (_state) {
+      case State::kSkipLine:
+        if (auto n = input.find('\n', _pos); n != std::string_view::npos) {
+          _pos = n + 1;
+          _state = State::kValue;
+        } else {
+          _pos = input.size();
+        }
+        continue;
+
+      case State::kString:
+        // Skips to the next quote or escape, rather than scanning byte by byte
+        if (auto n = input.find_first_of("\"\\", _pos); n == std::string_view::npos) {
+          _pos = input.size();
+        } else if (_pos = n + 1; input[n] == '\\') {
+          _state = State::kEscape;
+        } else if (_key) {
+          _key = false;
+          _state = State::kColon;
+        } else if (auto scan = endValue(); scan.status != Status::kPending) {
+          return scan;
+        }
+        continue;
+
+      case State::kEscape:
+        ++_pos;
+        _state = State::kString;
+        continue;
+
+      case State::kLiteral:
+        if (isLiteral(c)) {
+          ++_pos;
+        } else if (auto scan = endValue(); scan.status != Status::kPending) {
+          // Ends before |c|, which is scanned in the following state
+          return scan;
+        }
+        continue;
+
+      default:
+        break;
+    }
+
+    if (isSpace(c)) {
+      ++_pos;
+      continue;
+    }
+    switch (_state) {
+      case State::kValueOrEnd:
+        if (c == ']') {
+          if (auto scan = close(c); scan.status != Status::kPending) return scan;
+          continue;
+        }
+        [[fallthrough]];
+      case State::kValue:
+        if (c != '[' && c != '{' && c != '"' && c != '-' && !isDigit(c) && c != 't' && c != 'f' &&
+            c != 'n') {
+          return error();
+        }
+        beginValue(c);
+        continue;
+
+      case State::kKeyOrEnd:
+        if (c == '}') {
+          if (auto scan = close(c); scan.status != Status::kPending) return scan;
+          continue;
+        }
+        [[fallthrough]];
+      case State::kKey:
+        if (c != '"') {
+          return error();
+        }
+        ++_pos;
+        _key = true;
+        _state = State::kString;
+        continue;
+
+      case State::kColon:
+        if (c != ':') {
+          return error();
+        }
+        ++_pos;
+        _state = State::kValue;
+        continue;
+
+      case State::kCommaOrEnd:
+        if (c == ',') {
+          ++_pos;
+          _state = _stack.back() == '[' ? State::kValue : State::kKey;
+        } else if (auto scan = close(c); scan.status != Status::kPending) {
+          return scan;
+        }
+        continue;
+
+      default:
+        return error();
+    }
+  }
+
+  if (!eof || _state == State::kSkipLine || (_state == State::kValue && _stack.empty())) {
+    return {};
+  } else if (_state == State::kLiteral && _stack.empty()) {
+    return endValue();
+  }
+  // Unterminated
+  return error();
+}
+
+void JsonScanner::beginValue(char c) {
+  if (c == '[' && _stack.empty() && _split_arrays) {
+    _split = true;
+  } else if (isOutermost()) {
+    _begin = _pos;
+    _in_value = true;
+  }
+  ++_pos;
+
+  if (c == '[' || c == '{') {
+    _stack.push_back(c);
+    _state = c == '[' ? State::kValueOrEnd : State::kKeyOrEnd;
+  } else if (c == '"') {
+    _state = State::kString;
+  } else {
+    _state = State::kLiteral;
+  }
+}
+
+auto JsonScanner::endValue() -> Scan {
+  _state = _stack.empty() ? State::kValue : State::kCommaOrEnd;
+  if (!isOutermost()) {
+    return {};
+  }
+  _in_value = false;
+  return {.status = Status::kValue, .begin = _begin, .end = _pos};
+}
+
+auto JsonScanner::close(char c) -> Scan {
+  if (_stack.empty() || _stack.back() != (c == ']' ? '[' : c == '}' ? '{' : 0)) {
+    return error();
+  }
+  ++_pos;
+  _stack.pop_back();
+
+  if (_split && _stack.empty()) {
+    // The split array itself, whose elements were already returned
+    _split = false;
+    _state = State::kValue;
+    return {};
+  }
+  return endValue();
+}
+
+auto JsonScanner::error() -> Scan {
+  _stack.clear();
+  _split = false;
+  _in_value = false;
+  _key = false;
+  _state = State::kSkipLine;
+  return {.status = Status::kError};
+}
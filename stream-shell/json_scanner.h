@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * Incrementally finds complete JSON values in a byte stream, scanning each byte once as it arrives.
+ * Like a SAX reader it only tracks structure, i.e. nesting, strings and where literals end, and
+ * values are parsed once complete. This keeps memory bounded by the largest value rather than by
+ * the input, and with |split_arrays| by the largest element of a top-level array, e.g. of a large
+ * API response.
+ */
+class JsonScanner {
+ public:
+  enum class Status { kPending, kValue, kError };
+
+  struct Scan {
+    Status status = Status::kPending;
+    // Offsets of the value in the input, if any
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  explicit JsonScanner(bool split_arrays = false) : _split_arrays{split_arrays} {}
+
+  /**
+   * Scans |input| from where the previous call stopped, returning the next complete value, an
+   * error, or |kPending| if more input is needed. Once |eof| is set, a trailing literal is
+   * complete and an unterminated value is an error. Scanning resumes on the line following an
+   * error, so that a malformed line of NDJSON only skips that line.
+   */
+  Scan next(std::string_view input, bool eof = false);
+
+  /**
+   * Offset of the first byte that's still needed, i.e. of the value being scanned.
+   */
+  size_t consumed() const { return _in_value ? _begin : _pos; }
+
+  /**
+   * Shifts offsets after up to |consumed()| bytes were erased from the front of the input.
+   */
+  void drop(size_t n) {
+    _pos -= n;
+    if (_in_value) _begin -= n;
+  }
+
+ private:
+  enum class State : uint8_t {
+    kValue,
+    kValueOrEnd,
+    kKeyOrEnd,
+    kKey,
+    kColon,
+    kCommaOrEnd,
+    kString,
+    kEscape,
+    kLiteral,
+    kSkipLine,
+  };
+
+  void beginValue(char c);
+  Scan endValue();
+  Scan close(char c);
+  Scan error();
+  // Whether values begun at the current depth are returned, i.e. top-level values or elements
+  bool isOutermost() const { return _stack.empty() || (_split && _stack.size() == 1); }
+
+  bool _split_arrays;
+  // Open arrays and objects, as their opening bracket
+  std::vector<char> _stack;
+  State _state = State::kValue;
+  size_t _pos = 0;
+  size_t _begin = 0;
+  bool _in_value = false;
+  // Whether the string being scanned is a key
+  bool _key = false;
+  // Whether the outermost array is split into its elements
+  bool _split = false;
+};
@@ -0,0 +1,279 @@
+#include "kernels.h"
+
+#include <cmath>
+#include <cstdint>
+
+#if __x86_64__ || __i386__
+#include <immintrin.h>
+#define STSH_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+template <typename Op>
+void loop(Op op, const double *lhs, size_t l, const double *rhs, size_t r, double *out, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = op(lhs[i * l], rhs[i * r]);
+  }
+}
+
+// Whether |d| truncated fits an int64, which isn't the case for NaN
+bool isInt64(double d) {
+  return d >= -0x1p63 && d < 0x1p63;
+}
+
+/**
+ * Portable fallback. The loops are simple enough for the compiler to vectorize with the baseline
+ * instruction set of the target, e.g. SSE2 or NEON.
+ */
+void runScalar(Kernel kernel,
+               const double *lhs,
+               size_t l,
+               const double *rhs,
+               size_t r,
+               double *out,
+               size_t n) {
+  switch (kernel) {
+    case Kernel::kAdd:
+      return loop(std::plus<>(), lhs, l, rhs, r, out, n);
+    case Kernel::kSub:
+      return loop(std::minus<>(), lhs, l, rhs, r, out, n);
+    case Kernel::kMul:
+      return loop(std::multiplies<>(), lhs, l, rhs, r, out, n);
+    case Kernel::kDiv:
+      return loop(std::divides<>(), lhs, l, rhs, r, out, n);
+    case Kernel::kMod:
+      // On the operands truncated to integers, if they're in range
+      return loop(
+          [](double a, double b) {
+            if (!isInt64(a) || !isInt64(b) || !int64_t(b)) {
+              return std::nan("");
+            }
+            // The remainder of dividing by -1 is 0, but INT64_MIN % -1 overflows
+            return int64_t(b) == -1 ? 0. : double(int64_t(a) % int64_t(b));
+          },
+          lhs, l, rhs, r, out, n);
+    case Kernel::kEq:
+      return loop([](double a, double b) { return double(a == b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kNe:
+      return loop([](double a, double b) { return double(a != b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kLt:
+      return loop([](double a, double b) { return double(a < b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kLe:
+      return loop([](double a, double b) { return double(a <= b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kGt:
+      return loop([](double a, double b) { return double(a > b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kGe:
+      return loop([](double a, double b) { return double(a >= b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kAnd:
+      return loop([](double a, double b) { return double(a && b); }, lhs, l, rhs, r, out, n);
+    case Kernel::kOr:
+      return loop([](double a, double b) { return double(a || b); }, lhs, l, rhs, r, out, n);
+  }
+}
+
+/**
+ * Integer operations write |out| and return whether it overflowed. Addition and subtraction check
+ * the signs rather than use the overflow builtins, so that the loops still vectorize.
+ */
+template <typename Op>
+bool loopInt(Op op,
+             const int64_t *lhs,
+             size_t l,
+             const int64_t *rhs,
+             size_t r,
+             int64_t *out,
+             size_t n) {
+  bool overflow = false;
+  for (size_t i = 0; i < n; ++i) {
+    overflow |= op(lhs[i * l], rhs[i * r], out[i]);
+  }
+  return !overflow;
+}
+
+bool runInt(Kernel kernel,
+            const int64_t *lhs,
+            size_t l,
+            const int64_t *rhs,
+            size_t r,
+            int64_t *out,
+            size_t n) {
+  auto cmp = [](auto pred) {
+    return [pred](int64_t a, int64_t b, int64_t &out) {
+      out = pred(a, b);
+      return false;
+    };
+  };
+  switch (kernel) {
+    case Kernel::kAdd:
+      return loopInt(
+          [](int64_t a, int64_t b, int64_t &out) {
+            out = int64_t(uint64_t(a) + uint64_t(b));
+            return ((a ^ out) & (b ^ out)) < 0;
+          },
+          lhs, l, rhs, r, out, n);
+    case Kernel::kSub:
+      return loopInt(
+          [](int64_t a, int64_t b, int64_t &out) {
+            out = int64_t(uint64_t(a) - uint64_t(b));
+            return ((a ^ b) & (a ^ out)) < 0;
+          },
+          lhs, l, rhs, r, out, n);
+    case Kernel::kMul:
+      return loopInt(
+          [](int64_t a, int64_t b, int64_t &out) { return __builtin_mul_overflow(a, b, &out); },
+          lhs, l, rhs, r, out, n);
+    case Kernel::kDiv:
+      return false;
+    case Kernel::kMod:
+      return loopInt(
+          [](int64_t a, int64_t b, int64_t &out) {
+            // The remainder of dividing by -1 is 0, but INT64_MIN % -1 overflows
+            out = b && b != -1 ? a % b : 0;
+            return b == 0;
+          },
+          lhs, l, rhs, r, out, n);
+    case Kernel::kEq:
+      return loopInt(cmp(std::equal_to<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kNe:
+      return loopInt(cmp(std::not_equal_to<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kLt:
+      return loopInt(cmp(std::less<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kLe:
+      return loopInt(cmp(std::less_equal<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kGt:
+      return loopInt(cmp(std::greater<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kGe:
+      return loopInt(cmp(std::greater_equal<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kAnd:
+      return loopInt(cmp(std::logical_and<>()), lhs, l, rhs, r, out, n);
+    case Kernel::kOr:
+      return loopInt(cmp(std::logical_or<>()), lhs, l, rhs, r, out, n);
+  }
+  return false;
+}
+
+#ifdef STSH_AVX2
+
+// Functors rather than lambdas, since lambdas don't inherit the target attribute
+template <int kPredicate>
+struct Cmp {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const {
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, kPredicate), _mm256_set1_pd(1));
+  }
+};
+
+struct Add {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const { return _mm256_add_pd(a, b); }
+};
+struct Sub {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const { return _mm256_sub_pd(a, b); }
+};
+struct Mul {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const { return _mm256_mul_pd(a, b); }
+};
+struct Div {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const { return _mm256_div_pd(a, b); }
+};
+
+template <bool kAll>
+struct Logical {
+  STSH_AVX2 __m256d operator()(__m256d a, __m256d b) const {
+    auto zero = _mm256_setzero_pd();
+    // Unordered, so that NaN is truthy like in C++
+    auto x = _mm256_cmp_pd(a, zero, _CMP_NEQ_UQ), y = _mm256_cmp_pd(b, zero, _CMP_NEQ_UQ);
+    return _mm256_and_pd(kAll ? _mm256_and_pd(x, y) : _mm256_or_pd(x, y), _mm256_set1_pd(1));
+  }
+};
+
+STSH_AVX2 __m256d load(const double *p, size_t stride) {
+  return stride ? _mm256_loadu_pd(p) : _mm256_broadcast_sd(p);
+}
+
+/**
+ * Processes whole vectors of 4 doubles, returning how many elements were written.
+ */
+template <typename Op>
+STSH_AVX2 size_t
+loopAvx2(Op op, const double *lhs, size_t l, const double *rhs, size_t r, double *out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(out + i, op(load(lhs + i * l, l), load(rhs + i * r, r)));
+  }
+  return i;
+}
+
+STSH_AVX2 size_t runAvx2(Kernel kernel,
+                         const double *lhs,
+                         size_t l,
+                         const double *rhs,
+                         size_t r,
+                         double *out,
+                         size_t n) {
+  switch (kernel) {
+    case Kernel::kAdd:
+      return loopAvx2(Add(), lhs, l, rhs, r, out, n);
+    case Kernel::kSub:
+      return loopAvx2(Sub(), lhs, l, rhs, r, out, n);
+    case Kernel::kMul:
+      return loopAvx2(Mul(), lhs, l, rhs, r, out, n);
+    case Kernel::kDiv:
+      return loopAvx2(Div(), lhs, l, rhs, r, out, n);
+    case Kernel::kMod:
+      // No vector instruction for integer division
+      return 0;
+    case Kernel::kEq:
+      return loopAvx2(Cmp<_CMP_EQ_OQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kNe:
+      return loopAvx2(Cmp<_CMP_NEQ_UQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kLt:
+      return loopAvx2(Cmp<_CMP_LT_OQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kLe:
+      return loopAvx2(Cmp<_CMP_LE_OQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kGt:
+      return loopAvx2(Cmp<_CMP_GT_OQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kGe:
+      return loopAvx2(Cmp<_CMP_GE_OQ>(), lhs, l, rhs, r, out, n);
+    case Kernel::kAnd:
+      return loopAvx2(Logical<true>(), lhs, l, rhs, r, out, n);
+    case Kernel::kOr:
+      return loopAvx2(Logical<false>(), lhs, l, rhs, r, out, n);
+  }
+  return 0;
+}
+
+bool hasAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+#endif
+
+}  // namespace
+
+void runKernel(Kernel kernel,
+               const double *lhs,
+               size_t l,
+               const double *rhs,
+               size_t r,
+               double *out,
+               size_t n) {
+  size_t i = 0;
+#ifdef STSH_AVX2
+  if (hasAvx2()) {
+    i = runAvx2(kernel, lhs, l, rhs, r, out, n);
+  }
+#endif
+  // Remaining elements that don't fill a vector
+  runScalar(kernel, lhs + i * l, l, rhs + i * r, r, out + i, n - i);
+}
+
+bool runKernel(Kernel kernel,
+               const int64_t *lhs,
+               size_t l,
+               const int64_t *rhs,
+               size_t r,
+               int64_t *out,
+               size_t n) {
+  return runInt(kernel, lhs, l, rhs, r, out, n);
+}
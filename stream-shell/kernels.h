@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+/**
+ * Element-wise operations on contiguous buffers of doubles, as stored in chunks.
+ */
+enum class Kernel { kAdd, kSub, kMul, kDiv, kMod, kEq, kNe, kLt, kLe, kGt, kGe, kAnd, kOr };
+
+template <typename Op>
+inline constexpr std::optional<Kernel> kKernel = std::nullopt;
+
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::plus<>> = Kernel::kAdd;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::minus<>> = Kernel::kSub;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::multiplies<>> = Kernel::kMul;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::divides<>> = Kernel::kDiv;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::modulus<>> = Kernel::kMod;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::equal_to<>> = Kernel::kEq;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::not_equal_to<>> = Kernel::kNe;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::less<>> = Kernel::kLt;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::less_equal<>> = Kernel::kLe;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::greater<>> = Kernel::kGt;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::greater_equal<>> = Kernel::kGe;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::logical_and<>> = Kernel::kAnd;
+template <>
+inline constexpr std::optional<Kernel> kKernel<std::logical_or<>> = Kernel::kOr;
+
+/**
+ * Computes |out[i] = lhs[i * l] op rhs[i * r]| for |n| elements, where a stride of 0 broadcasts a
+ * single value. Comparisons and logical operations produce 0 or 1, and |kMod| truncates to
+ * integers, producing NaN for a zero divisor. Uses AVX2 when the CPU supports it, otherwise a
+ * portable loop.
+ */
+void runKernel(Kernel kernel,
+               const double *lhs,
+               size_t l,
+               const double *rhs,
+               size_t r,
+               double *out,
+               size_t n);
+
+/**
+ * Integer counterpart of the above, keeping results exact. Returns false if the operation isn't
+ * exact on integers, i.e. division, overflow or a zero divisor, in which case it should be computed
+ * on doubles instead.
+ */
+bool runKernel(Kernel kernel,
+               const int64_t *lhs,
+               size_t l,
+               const int64_t *rhs,
+               size_t r,
+               int64_t *out,
+               size_t n);
@@ -1,6 +1,28 @@
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <sstream>
 #include "linenoise.h"
 #include "repl.h"
 
 int main(int argc, char **argv) {
+  auto args = std::span(argv, argc);
+
+  if (args.size() >= 3 && args[1] == "-c"sv) {
+    // stsh -c <command> [args...]
+    std::istringstream script(args[2]);
+    auto script_args = std::vector<std::string>(args.begin() + 2, args.end());
+    script_args[0] = args[0];  // $0 is the shell itself
+    return runScript(script, std::move(script_args));
+
+  } else if (args.size() >= 2) {
+    // stsh <script> [args...]
+    std::ifstream script(args[1]);
+    if (!script.is_open()) {
+      std::cerr << "stsh: cannot open " << args[1] << std::endl;
+      return 127;
+    }
+    return runScript(script, std::vector<std::string>(args.begin() + 1, args.end()));
+  }
   return repl(linenoise), 0;
 }
@@ -1,9 +1,10 @@
 #pragma once
 
+#include "chunk.h"
 #include "stream_parser.h"
 #include "variant_ext.h"
 
-using Operand = variant_ext_t<Value, Stream, StreamRef>;
+using Operand = variant_ext_t<Value, Stream, ChunkStream, StreamRef>;
 
 template <typename T>
 concept IsValue = InVariant<Value, T>;
@@ -23,6 +23,9 @@ inline bool isTruthy(const google::protobuf::Value &value) {
   }
   return false;
 }
+inline bool isTruthy(const google::protobuf::Int64Value &value) {
+  return value.value() > 0;
+}
 inline bool isTruthy(const google::protobuf::Any &value) {
   return true;
 }
@@ -44,45 +47,154 @@ struct TernaryConditional {
 };
 
 struct Iota {
-  auto operator()(int64_t from) -> Stream { return ranges::views::iota(from) | toNumber; }
+  auto operator()(int64_t from) -> Stream {
+    return (*this)(from, std::numeric_limits<int64_t>::max());
+  }
   auto operator()(int64_t from, int64_t to) -> Stream {
-    return ranges::views::iota(from, to + 1) | toNumber;
+    if (to < from) {
+      return {};
+    }
+    // Closed, so that |to| can be the largest integer
+    return ranges::views::closed_iota(from, to) | ranges::views::transform(makeInt);
   }
+};
 
- private:
-  static constexpr auto toNumber = ranges::views::transform([](auto i) {
-    google::protobuf::Value value;
-    value.set_number_value(i);
-    return value;
-  });
+// Primitives that are broadcast against chunks, and bound ranges
+template <typename T>
+concept IsPrimitive =
+    std::is_same_v<T, google::protobuf::Value> || std::is_same_v<T, google::protobuf::Int64Value>;
+
+/**
+ * Operators, decoded from their token once when the parser builds an operation.
+ */
+enum class Op {
+  kPlus,
+  kMinus,
+  kMul,
+  kDiv,
+  kMod,
+  kEq,
+  kNe,
+  kLt,
+  kLe,
+  kGt,
+  kGe,
+  kAnd,
+  kOr,
+  kNot,
+  kRange,
+  kBackground,
+  kTernary,
 };
 
-struct Background {
-  auto operator()(const auto &) -> Stream {
-    // todo: implement backgrounding
+inline std::optional<Op> toOp(std::string_view op) {
+  if (op == "+") return Op::kPlus;
+  if (op == "-") return Op::kMinus;
+  if (op == "*") return Op::kMul;
+  if (op == "/") return Op::kDiv;
+  if (op == "%") return Op::kMod;
+  if (op == "==") return Op::kEq;
+  if (op == "!=") return Op::kNe;
+  if (op == "<") return Op::kLt;
+  if (op == "<=") return Op::kLe;
+  if (op == ">") return Op::kGt;
+  if (op == ">=") return Op::kGe;
+  if (op == "&&") return Op::kAnd;
+  if (op == "||") return Op::kOr;
+  if (op == "!") return Op::kNot;
+  if (op == "..") return Op::kRange;
+  if (op == "&") return Op::kBackground;
+  if (op == ":") return Op::kTernary;
+  return {};
+}
+
+struct InvalidOp {
+  auto operator()(const auto &...) -> Stream {
     return ranges::yield(std::unexpected(Error::kInvalidOp));
   }
 };
 
+using UnaryValueOp = Stream (*)(const Value &);
+using BinaryValueOp = Stream (*)(const Value &, const Value &);
+
+template <typename T>
+Stream visitValue(const Value &value) {
+  return std::visit(T(), value);
+}
+template <typename T>
+Stream visitValues(const Value &lhs, const Value &rhs) {
+  return std::visit(T(), lhs, rhs);
+}
+
+inline UnaryValueOp unaryValueOp(Op op) {
+  switch (op) {
+    case Op::kPlus:
+      return visitValue<ValueOp<std::identity>>;
+    case Op::kMinus:
+      return visitValue<ValueOp<std::negate<>>>;
+    case Op::kNot:
+      return visitValue<ValueOp<std::logical_not<>, bool>>;
+    case Op::kRange:
+      return visitValue<ValueOp<Iota>>;
+    default:
+      return visitValue<InvalidOp>;
+  }
+}
+
+inline BinaryValueOp binaryValueOp(Op op) {
+  switch (op) {
+    case Op::kOr:
+      return visitValues<ValueOp<std::logical_or<>, bool>>;
+    case Op::kAnd:
+      return visitValues<ValueOp<std::logical_and<>, bool>>;
+    case Op::kEq:
+      return visitValues<ValueOp<std::equal_to<>, bool>>;
+    case Op::kNe:
+      return visitValues<ValueOp<std::not_equal_to<>, bool>>;
+    case Op::kLt:
+      return visitValues<ValueOp<std::less<>, bool>>;
+    case Op::kLe:
+      return visitValues<ValueOp<std::less_equal<>, bool>>;
+    case Op::kGt:
+      return visitValues<ValueOp<std::greater<>, bool>>;
+    case Op::kGe:
+      return visitValues<ValueOp<std::greater_equal<>, bool>>;
+    case Op::kPlus:
+      return visitValues<ValueOp<std::plus<>>>;
+    case Op::kMinus:
+      return visitValues<ValueOp<std::minus<>>>;
+    case Op::kMul:
+      return visitValues<ValueOp<std::multiplies<>>>;
+    case Op::kDiv:
+      return visitValues<ValueOp<std::divides<>>>;
+    case Op::kMod:
+      return visitValues<ValueOp<std::modulus<>>>;
+    case Op::kRange:
+      return visitValues<ValueOp<Iota>>;
+    default:
+      return visitValues<InvalidOp>;
+  }
+}
+
 /**
- * Visits Operand variants transforming Values. For use in operators and builins
+ * Visits Operand variants applying an operation on Values. For use in operators and builins
  */
 template <typename ValueT>
 struct ValueTransform {
-  ValueTransform(ValueT &&value_t) : _value_t(std::move(value_t)) {}
+  ValueTransform(ValueT value_t) : _value_t(std::move(value_t)) {}
 
-  auto operator()(const IsValue auto &...v) -> Stream { return _value_t(v...); }
+  auto operator()(const IsValue auto &...v) -> Stream { return _value_t(Value(v)...); }
   auto operator()(const auto &...v) -> Stream { return eval(v...); }
 
  private:
   auto eval(const Stream &s) -> Stream {
     return Stream(s) | ranges::views::for_each([value_t = _value_t](const Result<Value> &result) {
-             return result ? std::visit(value_t, *result) : ranges::yield(result);
+             return result ? value_t(*result) : ranges::yield(result);
            });
   }
 
   auto eval(const Result<Value> &lhs, const Result<Value> &rhs) -> Stream {
-    return rhs ? lhs ? std::visit(_value_t, *lhs, *rhs) : ranges::yield(lhs) : ranges::yield(rhs);
+    return rhs ? lhs ? _value_t(*lhs, *rhs) : ranges::yield(lhs) : ranges::yield(rhs);
   }
   auto eval(const Stream &lhs, const IsValue auto &rhs) -> Stream {
     return eval(lhs, Stream(ranges::yield(rhs)));
@@ -102,40 +214,134 @@ struct ValueTransform {
   ValueT _value_t;
 };
 
+inline const auto &unchunked(const auto &v) {
+  return v;
+}
+inline Stream unchunked(const ChunkStream &chunks) {
+  return unchunk(chunks);
+}
+
+/**
+ * Applies an operator on 1 to 3 operands. Operations on values are resolved to a function pointer
+ * up front, so that evaluating each element of a stream is a direct call.
+ */
 struct OperandOp {
-  OperandOp(Token op) : op{op} {}
-
-  auto operator()(const auto &v) const -> Stream {
-    return ValueTransform([&](const auto &v) -> Stream {
-      if (op == "+") return ValueOp<std::identity>()(v);
-      if (op == "-") return ValueOp<std::negate<>>()(v);
-      if (op == "!") return ValueOp<std::logical_not<>, bool>()(v);
-      if (op == "..") return ValueOp<Iota>()(v);
-      if (op == "&") return Background()(v);
-      return ranges::yield(std::unexpected(Error::kInvalidOp));
-    })(v);
-  }
-  auto operator()(const auto &...v) const -> Operand {
-    if (op == ":") return TernaryConditional()(v...);
-    return ValueTransform([op = op](const auto &...v) -> Stream {
-      if (op == "||") return ValueOp<std::logical_or<>, bool>()(v...);
-      if (op == "&&") return ValueOp<std::logical_and<>, bool>()(v...);
-      if (op == "==") return ValueOp<std::equal_to<>, bool>()(v...);
-      if (op == "!=") return ValueOp<std::not_equal_to<>, bool>()(v...);
-      if (op == "<") return ValueOp<std::less<>, bool>()(v...);
-      if (op == "<=") return ValueOp<std::less_equal<>, bool>()(v...);
-      if (op == ">") return ValueOp<std::greater<>, bool>()(v...);
-      if (op == ">=") return ValueOp<std::greater_equal<>, bool>()(v...);
-      if (op == "+") return ValueOp<std::plus<>>()(v...);
-      if (op == "-") return ValueOp<std::minus<>>()(v...);
-      if (op == "*") return ValueOp<std::multiplies<>>()(v...);
-      if (op == "/") return ValueOp<std::divides<>>()(v...);
-      if (op == "%") return ValueOp<std::modulus<>>()(v...);
-      if (op == "..") return ValueOp<Iota>()(v...);
-      return ranges::yield(std::unexpected(Error::kInvalidOp));
-    })(v...);
+  OperandOp(Op op) : op{op} {}
+
+  auto operator()(const ChunkStream &chunks) const -> Operand {
+    auto map = [&](auto value_op) -> ChunkStream {
+      return ChunkStream(chunks) |
+             ranges::views::transform([value_op](const Result<Chunk> &chunk) mutable {
+               return chunk.and_then(value_op);
+             });
+    };
+    switch (op) {
+      case Op::kPlus:
+        return chunks;
+      case Op::kMinus:
+        return map(ValueOp<std::negate<>>());
+      case Op::kNot:
+        return map(ValueOp<std::logical_not<>, bool>());
+      default:
+        return (*this)(unchunk(chunks));
+    }
+  }
+  auto operator()(const auto &v) const -> Operand {
+    if constexpr (IsPrimitive<std::decay_t<decltype(v)>>) {
+      if (auto from = rangeBound(v); op == Op::kRange && from) {
+        return iotaChunks(*from);
+      }
+    }
+    return ValueTransform(unaryValueOp(op))(v);
+  }
+  auto operator()(const auto &lhs, const auto &rhs) const -> Operand {
+    if (auto chunks = chunkOp(lhs, rhs)) {
+      return *chunks;
+    }
+    return ValueTransform(binaryValueOp(op))(unchunked(lhs), unchunked(rhs));
+  }
+  auto operator()(const auto &a, const auto &b, const auto &c) const -> Operand {
+    if (op == Op::kTernary) return TernaryConditional()(unchunked(a), unchunked(b), unchunked(c));
+    return Stream(ranges::yield(std::unexpected(Error::kInvalidOp)));
   }
 
  private:
-  Token op;
+  /**
+   * Evaluates binary operations on chunks if either operand is a chunked stream and the other is
+   * a chunked stream or a primitive.
+   */
+  auto chunkOp(const auto &lhs, const auto &rhs) const -> std::optional<ChunkStream> {
+    using L = std::decay_t<decltype(lhs)>;
+    using R = std::decay_t<decltype(rhs)>;
+
+    if constexpr (IsPrimitive<L> && IsPrimitive<R>) {
+      if (auto from = rangeBound(lhs), to = rangeBound(rhs); op == Op::kRange && from && to) {
+        return iotaChunks(*from, *to);
+      }
+    } else if constexpr (std::is_same_v<L, ChunkStream> && std::is_same_v<R, ChunkStream>) {
+      return visitChunkOp([&](auto value_op) -> ChunkStream {
+        return ranges::views::zip(ChunkStream(lhs), ChunkStream(rhs)) |
+               ranges::views::transform([value_op](const auto &chunks) mutable -> Result<Chunk> {
+                 auto &[lhs, rhs] = chunks;
+                 return lhs.and_then([&](auto &lhs) {
+                   return rhs.and_then([&](auto &rhs) { return value_op(lhs, rhs); });
+                 });
+               });
+      });
+    } else if constexpr (std::is_same_v<L, ChunkStream> && IsPrimitive<R>) {
+      if (auto scalar = Chunk::fromScalar(rhs)) {
+        return visitChunkOp([&](auto value_op) -> ChunkStream {
+          return ChunkStream(lhs) |
+                 ranges::views::transform([value_op, scalar = *scalar](const auto &chunk) mutable {
+                   return chunk.and_then([&](auto &chunk) { return value_op(chunk, scalar); });
+                 });
+        });
+      }
+    } else if constexpr (IsPrimitive<L> && std::is_same_v<R, ChunkStream>) {
+      if (auto scalar = Chunk::fromScalar(lhs)) {
+        return visitChunkOp([&](auto value_op) -> ChunkStream {
+          return ChunkStream(rhs) |
+                 ranges::views::transform([value_op, scalar = *scalar](const auto &chunk) mutable {
+                   return chunk.and_then([&](auto &chunk) { return value_op(scalar, chunk); });
+                 });
+        });
+      }
+    }
+    return {};
+  }
+
+  auto visitChunkOp(auto f) const -> std::optional<ChunkStream> {
+    switch (op) {
+      case Op::kOr:
+        return f(ValueOp<std::logical_or<>, bool>());
+      case Op::kAnd:
+        return f(ValueOp<std::logical_and<>, bool>());
+      case Op::kEq:
+        return f(ValueOp<std::equal_to<>, bool>());
+      case Op::kNe:
+        return f(ValueOp<std::not_equal_to<>, bool>());
+      case Op::kLt:
+        return f(ValueOp<std::less<>, bool>());
+      case Op::kLe:
+        return f(ValueOp<std::less_equal<>, bool>());
+      case Op::kGt:
+        return f(ValueOp<std::greater<>, bool>());
+      case Op::kGe:
+        return f(ValueOp<std::greater_equal<>, bool>());
+      case Op::kPlus:
+        return f(ValueOp<std::plus<>>());
+      case Op::kMinus:
+        return f(ValueOp<std::minus<>>());
+      case Op::kMul:
+        return f(ValueOp<std::multiplies<>>());
+      case Op::kDiv:
+        return f(ValueOp<std::divides<>>());
+      case Op::kMod:
+        return f(ValueOp<std::modulus<>>());
+      default:
+        return {};
+    }
+  }
+
+  Op op;
 };
@@ -0,0 +1,198 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <range/v3/all.hpp>
+#include "job.h"
+#include "worker_pool.h"
+
+namespace {
+
+WorkerPool &parallelPool() {
+  static WorkerPool pool;
+  return pool;
+}
+
+struct Task {
+  std::vector<Result<Value>> results;
+  bool done = false;
+};
+
+/**
+ * State shared between a parallel map and its tasks, which may outlive it.
+ */
+struct Shared {
+  bool ordered = true;
+  std::function<Result<StreamFactory>()> make_closure;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  // Closure instances not used by a task
+  std::vector<StreamFactory> idle;
+  // Tasks done but not yet consumed, if unordered
+  std::deque<std::shared_ptr<Task>> done;
+
+  Result<StreamFactory> acquire() {
+    {
+      std::lock_guard lock(mutex);
+      if (!idle.empty()) {
+        auto closure = std::move(idle.back());
+        idle.pop_back();
+        return closure;
+      }
+    }
+    return make_closure();
+  }
+
+  void complete(const std::shared_ptr<Task> &task,
+                std::vector<Result<Value>> results,
+                std::optional<StreamFactory> closure) {
+    {
+      std::lock_guard lock(mutex);
+      task->results = std::move(results);
+      task->done = true;
+      if (!ordered) {
+        done.push_back(task);
+      }
+      if (closure) {
+        idle.push_back(std::move(*closure));
+      }
+    }
+    cv.notify_all();
+  }
+};
+
+class ParallelMap {
+ public:
+  ParallelMap(Stream input, std::shared_ptr<Shared> shared, size_t jobs)
+      : _input{std::move(input)}, _shared{std::move(shared)}, _jobs{jobs} {}
+
+  std::optional<Result<Value>> next() {
+    while (_index == _results.size()) {
+      fill();
+      auto task = wait();
+      if (!task) {
+        return std::nullopt;
+      }
+      _results = std::move(task->results);
+      _index = 0;
+    }
+    return std::move(_results[_index++]);
+  }
+
+ private:
+  // How long to wait for a task before checking for queued ones to help with
+  static constexpr auto kHelpInterval = std::chrono::milliseconds(10);
+
+  void fill() {
+    if (!_it) {
+      _it = ranges::begin(_input);
+    }
+    for (; _in_flight.size() < _jobs && *_it != ranges::end(_input); ++*_it) {
+      auto task = _in_flight.emplace_back(std::make_shared<Task>());
+      auto result = std::move(**_it);
+      if (!result) {
+        _shared->complete(task, {std::move(result)}, std::nullopt);
+        continue;
+      }
+      // Runs on behalf of this job, although pool threads are shared with other jobs
+      parallelPool().submit(withJob([shared = _shared, task, value = std::move(*result)] {
+        auto closure = shared->acquire();
+        if (!closure) {
+          return shared->complete(task, {std::unexpected(closure.error())}, std::nullopt);
+        }
+        auto results = (*closure)(ranges::yield(value)) | ranges::to<std::vector>;
+        shared->complete(task, std::move(results), std::move(*closure));
+      }));
+    }
+  }
+
+  std::shared_ptr<Task> wait() {
+    if (_in_flight.empty()) {
+      return nullptr;
+    }
+    std::unique_lock lock(_shared->mutex);
+    auto ready = [&] {
+      return _shared->ordered ? _in_flight.front()->done : !_shared->done.empty();
+    };
+    while (!ready()) {
+      lock.unlock();
+      auto helped = parallelPool().runPending();
+      lock.lock();
+      if (!helped && !ready()) {
+        _shared->cv.wait_for(lock, kHelpInterval);
+      }
+    }
+
+    std::shared_ptr<Task> task;
+    if (_shared->ordered) {
+      task = std::move(_in_flight.front());
+      _in_flight.pop_front();
+    } else {
+      task = std::move(_shared->done.front());
+      _shared->done.pop_front();
+      _in_flight.erase(ranges::find(_in_flight, task));
+    }
+    return task;
+  }
+
+  Stream _input;
+  std::optional<ranges::iterator_t<Stream>> _it;
+  std::shared_ptr<Shared> _shared;
+  size_t _jobs;
+  std::deque<std::shared_ptr<Task>> _in_flight;
+  std::vector<Result<Value>> _results;
+  size_t _index = 0;
+};
+
+}  // namespace
+
+Stream parallelMap(Stream input,
+                   StreamFactory closure,
+                   std::function<Result<StreamFactory>()> make_closure,
+                   const google::protobuf::Struct &config) {
+  size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+  auto &fields = config.fields();
+  // Flags following the number of jobs, e.g. `par 4 --unordered`, are merged into its subcommand
+  const google::protobuf::Struct *subcommand = nullptr;
+  if (auto it = fields.find("@"); it != fields.end() && it->second.list_value().values_size()) {
+    auto &args = it->second.list_value();
+    auto n = args.values(0).number_value();
+    if (args.values_size() != 1 || n < 1 || n != std::trunc(n)) {
+      return ranges::yield(std::unexpected(Error::kConfigError));
+    }
+    jobs = n;
+    if (auto it = fields.find(std::to_string(jobs)); it != fields.end()) {
+      subcommand = &it->second.struct_value();
+    }
+  }
+  auto flag = [&](const std::string &key) {
+    auto is_set = [&](const auto &fields) {
+      auto it = fields.find(key);
+      return it != fields.end() && it->second.bool_value();
+    };
+    return is_set(fields) || (subcommand && is_set(subcommand->fields()));
+  };
+  auto ordered = !flag("unordered") && !flag("u");
+
+  auto shared = std::make_shared<Shared>();
+  shared->ordered = ordered;
+  shared->make_closure = std::move(make_closure);
+  shared->idle.push_back(std::move(closure));
+
+  return ranges::views::generate([map = std::make_shared<ParallelMap>(
+                                      std::move(input), std::move(shared), jobs)] {
+           return map->next();
+         }) |
+         ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+         ranges::views::transform([](auto &&value) { return std::move(*value); });
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <functional>
+#include <google/protobuf/struct.pb.h>
+#include "stream_parser.h"
+
+/**
+ * Applies |closure| to each value of |input| on a shared pool of threads, e.g.
+ * `ls | par 8 { f -> ... }`, with at most the given number of values in flight (the number of
+ * cores by default). The results of each value are emitted together, in input order, or in order
+ * of completion with --unordered. Concurrent invocations use instances from |make_closure|, since
+ * an instance holds its parameters.
+ */
+Stream parallelMap(Stream input,
+                   StreamFactory closure,
+                   std::function<Result<StreamFactory>()> make_closure,
+                   const google::protobuf::Struct &config);
@@ -0,0 +1,50 @@
+#include "plan.h"
+
+#include <memory>
+#include <optional>
+#include <range/v3/all.hpp>
+
+Stream Plan::run(Stream input) && {
+  if (ops.empty()) {
+    return input;
+  }
+
+  struct State {
+    Stream input;
+    std::optional<ranges::iterator_t<Stream>> it;
+    std::vector<Operator> ops;
+    Batch batch, next;
+    size_t i = 0;
+  };
+  auto state = std::make_shared<State>(std::move(input), std::nullopt, std::move(ops));
+
+  return ranges::views::generate([state]() -> std::optional<Result<Value>> {
+           if (!state->it) {
+             state->it = ranges::begin(state->input);
+           }
+           while (state->i == state->batch.size()) {
+             if (*state->it == ranges::end(state->input)) {
+               return std::nullopt;
+             }
+             state->i = 0;
+             state->batch.clear();
+             state->batch.push_back(**state->it);
+             ++*state->it;
+
+             for (auto &op : state->ops) {
+               state->next.clear();
+               for (auto &result : state->batch) {
+                 if (result) {
+                   op(std::move(*result), state->next);
+                 } else {
+                   state->next.push_back(std::move(result));
+                 }
+               }
+               std::swap(state->batch, state->next);
+             }
+           }
+           return std::move(state->batch[state->i++]);
+         }) |
+         ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+         ranges::views::transform([](auto &&value) { return std::move(*value); });
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "stream_parser.h"
+
+using Batch = std::vector<Result<Value>>;
+
+/**
+ * Push-based operator, appending the values produced for a single input value to a batch.
+ */
+using Operator = std::function<void(Value, Batch &)>;
+
+/**
+ * A flat sequence of operators applied to each value of a stream. Values are passed between the
+ * operators in batches, so that the stream is only type-erased at the input and output of the plan
+ * instead of once per stage.
+ */
+struct Plan {
+  std::vector<Operator> ops;
+
+  Stream run(Stream input) &&;
+};
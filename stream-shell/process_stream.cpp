@@ -0,0 +1,206 @@
+#include "process_stream.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <range/v3/all.hpp>
+
+/**
+ * Single-producer ring of immutable nodes. Readers protect the node they copy from with a hazard
+ * pointer, and the producer only frees replaced nodes that no reader is protecting, so neither
+ * side takes a lock. A mutex is only used to put idle readers to sleep.
+ */
+class ProcessStream::Ring {
+ public:
+  ~Ring() {
+    for (auto &slot : _slots) {
+      delete slot.load();
+    }
+    for (auto *node : _retired) {
+      delete node;
+    }
+    for (auto *hazard = _hazards.load(); hazard;) {
+      delete std::exchange(hazard, hazard->next);
+    }
+  }
+
+  void publish(const Result<Value> &value) {
+    if (!_readers.load()) {
+      return;
+    }
+    auto seq = _end.load(std::memory_order_relaxed);
+    auto *node = new Node{.seq = seq, .value = value};
+    if (auto *replaced = _slots[seq % kCapacity].exchange(node)) {
+      retire(replaced);
+    }
+    _end.store(seq + 1);
+    wake();
+  }
+
+  void close() {
+    _closed.store(true);
+    wake();
+  }
+
+  Stream subscribe(std::shared_ptr<Ring> self, std::function<bool()> stopped) {
+    auto reader = std::make_shared<Reader>(std::move(self), std::move(stopped));
+    return ranges::views::generate([reader] { return reader->next(); }) |
+           ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
+           ranges::views::transform([](auto &&value) { return std::move(*value); });
+  }
+
+ private:
+  static constexpr auto kPollInterval = std::chrono::milliseconds(50);
+  static constexpr size_t kRetireBatch = 64;
+
+  struct Node {
+    uint64_t seq;
+    Result<Value> value;
+  };
+
+  struct Hazard {
+    std::atomic<Node *> node = nullptr;
+    std::atomic<bool> active = true;
+    Hazard *next = nullptr;
+  };
+
+  struct Reader {
+    Reader(std::shared_ptr<Ring> ring, std::function<bool()> stopped)
+        : ring{std::move(ring)},
+          stopped{std::move(stopped)},
+          hazard{this->ring->acquireHazard()},
+          seq{this->ring->_end.load()} {
+      ++this->ring->_readers;
+    }
+    ~Reader() {
+      --ring->_readers;
+      hazard->node.store(nullptr);
+      hazard->active.store(false);
+    }
+
+    std::optional<Result<Value>> next() {
+      for (;;) {
+        if (auto value = ring->read(*hazard, seq)) {
+          return value;
+        } else if (ring->_closed.load() && seq >= ring->_end.load()) {
+          return std::nullopt;
+        } else if (stopped()) {
+          return std::nullopt;
+        }
+        ring->sleep(seq);
+      }
+    }
+
+    std::shared_ptr<Ring> ring;
+    std::function<bool()> stopped;
+    Hazard *hazard;
+    uint64_t seq;
+  };
+
+  /**
+   * Copies the value at |seq|, or the oldest one kept if it was overwritten, advancing |seq|.
+   */
+  std::optional<Result<Value>> read(Hazard &hazard, uint64_t &seq) {
+    for (auto end = _end.load(); seq < end; end = _end.load()) {
+      seq = std::max(seq, end - std::min<uint64_t>(end, kCapacity));
+
+      auto &slot = _slots[seq % kCapacity];
+      // Protects the node from being freed, unless it was replaced before that took effect
+      Node *node;
+      do {
+        node = slot.load();
+        hazard.node.store(node);
+      } while (slot.load() != node);
+
+      if (node->seq != seq) {
+        // Overwritten since |end| was read
+        hazard.node.store(nullptr);
+        continue;
+      }
+      auto value = node->value;
+      hazard.node.store(nullptr);
+      ++seq;
+      return value;
+    }
+    return std::nullopt;
+  }
+
+  void retire(Node *node) {
+    _retired.push_back(node);
+    if (_retired.size() < kRetireBatch) {
+      return;
+    }
+    std::vector<Node *> protected_nodes;
+    for (auto *hazard = _hazards.load(); hazard; hazard = hazard->next) {
+      if (auto *node = hazard->node.load()) {
+        protected_nodes.push_back(node);
+      }
+    }
+    std::erase_if(_retired, [&](Node *node) {
+      if (std::ranges::find(protected_nodes, node) != protected_nodes.end()) {
+        return false;
+      }
+      delete node;
+      return true;
+    });
+  }
+
+  Hazard *acquireHazard() {
+    for (auto *hazard = _hazards.load(); hazard; hazard = hazard->next) {
+      if (auto inactive = false; hazard->active.compare_exchange_strong(inactive, true)) {
+        return hazard;
+      }
+    }
+    auto *hazard = new Hazard;
+    hazard->next = _hazards.load();
+    while (!_hazards.compare_exchange_weak(hazard->next, hazard)) {
+    }
+    return hazard;
+  }
+
+  void sleep(uint64_t seq) {
+    std::unique_lock lock(_mutex);
+    ++_sleeping;
+    // Bounded, since a wake-up may be missed between checking and waiting, and to poll |stopped|
+    _cv.wait_for(lock, kPollInterval, [&] { return _end.load() > seq || _closed.load(); });
+    --_sleeping;
+  }
+
+  void wake() {
+    if (_sleeping.load()) {
+      _cv.notify_all();
+    }
+  }
+
+  std::array<std::atomic<Node *>, kCapacity> _slots = {};
+  std::atomic<uint64_t> _end = 0;
+  std::atomic<bool> _closed = false;
+  std::atomic<size_t> _readers = 0;
+  std::atomic<Hazard *> _hazards = nullptr;
+  // Only accessed by the producer
+  std::vector<Node *> _retired;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::atomic<size_t> _sleeping = 0;
+};
+
+ProcessStream::ProcessStream() : _ring{std::make_shared<Ring>()} {}
+
+ProcessStream::~ProcessStream() {
+  _ring->close();
+}
+
+void ProcessStream::publish(const Result<Value> &value) {
+  _ring->publish(value);
+}
+
+Stream ProcessStream::subscribe(std::function<bool()> stopped) const {
+  return _ring->subscribe(_ring, std::move(stopped));
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include "stream_parser.h"
+
+/**
+ * Output of a running pipeline or child process, broadcast to any number of readers without
+ * back-pressure. Readers only see values published after they subscribed, and a reader falling
+ * more than |kCapacity| values behind skips ahead to the oldest value kept. Publishing never
+ * waits for readers, and is skipped while there are none. Readers see the end of the stream once
+ * this, the publishing side, is destroyed.
+ */
+class ProcessStream {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+  ProcessStream();
+  ~ProcessStream();
+
+  ProcessStream(const ProcessStream &) = delete;
+  ProcessStream &operator=(const ProcessStream &) = delete;
+
+  void publish(const Result<Value> &value);
+
+  /**
+   * Values published from now on, until the publisher is destroyed or |stopped| returns true.
+   */
+  Stream subscribe(std::function<bool()> stopped) const;
+
+ private:
+  class Ring;
+  std::shared_ptr<Ring> _ring;
+};
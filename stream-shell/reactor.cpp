@@ -0,0 +1,168 @@
+#include "reactor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+
+void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * Opens the wake pipe, which is not leaked into spawned children. Without pipe2, e.g. on macOS, a
+ * child forked concurrently may still inherit it before it's marked close-on-exec.
+ */
+bool makeWakePipe(int fds[2]) {
+#if __linux__ || __FreeBSD__ || __NetBSD__ || __OpenBSD__
+  return pipe2(fds, O_CLOEXEC | O_NONBLOCK) == 0;
+#else
+  if (pipe(fds) < 0) {
+    return false;
+  }
+  for (auto i = 0; i < 2; ++i) {
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    setNonBlocking(fds[i]);
+  }
+  return true;
+#endif
+}
+
+}  // namespace
+
+Reactor::~Reactor() {
+  {
+    std::lock_guard lock(_mutex);
+    _shutdown = true;
+    if (_thread.joinable()) {
+      interruptPoll();
+    }
+  }
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+  for (auto fd : _wake_fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+ssize_t Reactor::read(int fd,
+                      std::string &bytes,
+                      size_t max_size,
+                      const std::function<bool()> &stopped) {
+  std::unique_lock lock(_mutex);
+  if (!_thread.joinable()) {
+    if (!makeWakePipe(_wake_fds)) {
+      return -1;
+    }
+    _thread = std::thread([this] { run(); });
+  }
+
+  auto [it, inserted] = _sources.try_emplace(fd);
+  auto &source = it->second;
+  if (inserted || source.max_size != max_size) {
+    if (inserted) {
+      setNonBlocking(fd);
+    }
+    source.max_size = max_size;
+    interruptPoll();
+  }
+
+  auto ready = [&] { return !source.buffer.empty() || source.eof || source.error; };
+  while (!ready()) {
+    if (stopped()) {
+      return -1;
+    }
+    _cv.wait(lock);
+  }
+  if (source.buffer.empty()) {
+    return source.error ? -1 : 0;
+  }
+
+  auto was_full = source.buffer.size() >= source.max_size;
+  bytes.clear();
+  bytes.swap(source.buffer);
+  if (was_full) {
+    // Polled again now that there's room in the buffer
+    interruptPoll();
+  }
+  return bytes.size();
+}
+
+void Reactor::release(int fd) {
+  std::lock_guard lock(_mutex);
+  if (_sources.erase(fd)) {
+    interruptPoll();
+  }
+}
+
+void Reactor::wake() {
+  std::lock_guard lock(_mutex);
+  _cv.notify_all();
+}
+
+void Reactor::interruptPoll() {
+  char c = 0;
+  (void)!::write(_wake_fds[1], &c, 1);
+}
+
+void Reactor::run() {
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.assign(1, {.fd = _wake_fds[0], .events = POLLIN});
+    {
+      std::lock_guard lock(_mutex);
+      if (_shutdown) {
+        return;
+      }
+      for (auto &[fd, source] : _sources) {
+        if (!source.eof && !source.error && source.buffer.size() < source.max_size) {
+          fds.push_back({.fd = fd, .events = POLLIN});
+        }
+      }
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents) {
+      char buffer[64];
+      while (::read(_wake_fds[0], buffer, sizeof(buffer)) > 0);
+    }
+
+    std::lock_guard lock(_mutex);
+    auto notify = false;
+    for (size_t i = 1; i < fds.size(); ++i) {
+      auto &entry = fds[i];
+      // Skips descriptors released while polling. One released and reused for another source is
+      // read on behalf of that one, or not at all if it isn't ready
+      auto it = _sources.find(entry.fd);
+      if (!entry.revents || it == _sources.end()) {
+        continue;
+      }
+      auto &source = it->second;
+      auto size = source.buffer.size();
+      if (size >= source.max_size) {
+        continue;
+      }
+      source.buffer.resize(source.max_size);
+      auto n = ::read(entry.fd, source.buffer.data() + size, source.max_size - size);
+      source.buffer.resize(size + std::max<ssize_t>(n, 0));
+      if (n == 0) {
+        source.eof = true;
+      } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        source.error = true;
+      }
+      notify = notify || n >= 0 || source.error;
+    }
+    if (notify) {
+      _cv.notify_all();
+    }
+  }
+}
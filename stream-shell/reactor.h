@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+
+/**
+ * Reads any number of file descriptors on a single thread, so that all child processes keep
+ * producing output while one of them is consumed. Each descriptor is read without blocking into
+ * its own buffer, which is no longer polled while full, keeping back-pressure on the writer.
+ * Uses poll(2), which unlike epoll and kqueue is available on every platform we build for.
+ */
+class Reactor {
+ public:
+  Reactor() = default;
+  ~Reactor();
+
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  /**
+   * Moves the bytes read from |fd| into |bytes|, waiting until there are some, reading up to
+   * |max_size| bytes ahead. Returns their number, 0 at the end of file, or -1 on error or if
+   * |stopped| returns true, which is checked when woken by |wake|. The descriptor is made
+   * non-blocking and polled from the first read until it's released.
+   */
+  ssize_t read(int fd, std::string &bytes, size_t max_size, const std::function<bool()> &stopped);
+
+  /**
+   * Stops polling |fd|, which may be closed once this returns.
+   */
+  void release(int fd);
+
+  /**
+   * Wakes blocked readers to check whether they're stopped.
+   */
+  void wake();
+
+ private:
+  struct Source {
+    std::string buffer;
+    size_t max_size = 0;
+    bool eof = false;
+    bool error = false;
+  };
+
+  void run();
+  // Wakes the polling thread to poll an updated set of descriptors. Requires |_mutex|
+  void interruptPoll();
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::map<int, Source> _sources;
+  // Written to interrupt poll(2)
+  int _wake_fds[2] = {-1, -1};
+  std::thread _thread;
+  bool _shutdown = false;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <charconv>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+#include <google/protobuf/struct.pb.h>
+#include <google/protobuf/util/json_util.h>
+#include <range/v3/all.hpp>
+#include "operand.h"
+#include "scope.h"
+#include "stream_parser.h"
+#include "to_stream.h"
+#include "to_value.h"
+
+/**
+ * Record literal with fields that are evaluated each time the record is, e.g. `{ n: p.n * 2 }` in
+ * a closure. The JSON of the literal is parsed once, with placeholders in place of these fields,
+ * which are then set directly to the values of their operands.
+ */
+class RecordTemplate {
+ public:
+  /**
+   * JSON of the placeholder for the operand of |slot|, which can't be confused with a string
+   * literal since it starts with a control character.
+   */
+  static std::string placeholder(size_t slot) {
+    return "\"\\u0001" + std::to_string(slot) + "\"";
+  }
+
+  /**
+   * Parses |json|, containing placeholders for |slots|, into a record. The record is a stream if
+   * any operand must be evaluated.
+   */
+  static auto parse(Env &env,
+                    const Scope &scope,
+                    const std::string &json,
+                    std::vector<Operand> slots) -> Result<Operand> {
+    google::protobuf::Value record;
+    if (!google::protobuf::json::JsonStringToMessage(json, record.mutable_struct_value()).ok()) {
+      return std::unexpected(Error::kJsonError);
+    }
+    if (slots.empty()) {
+      return record;
+    }
+
+    auto tmpl = std::make_shared<RecordTemplate>();
+    tmpl->_record = std::move(record);
+    tmpl->_slots.resize(slots.size());
+    Path path;
+    tmpl->findSlots(tmpl->_record, path);
+    for (size_t i = 0; i < slots.size(); ++i) {
+      if (tmpl->_slots[i].path.empty()) {
+        // Not a field value, e.g. a key
+        return std::unexpected(Error::kJsonError);
+      }
+      tmpl->_slots[i].operand = std::move(slots[i]);
+    }
+
+    return ranges::yield(0) | ranges::views::transform([&env, scope, tmpl](int) {
+             return tmpl->eval(env, scope);
+           });
+  }
+
+ private:
+  // Field names and list indices from the record to a slot
+  using Path = std::vector<std::variant<std::string, int>>;
+
+  struct Slot {
+    Path path;
+    Operand operand;
+  };
+
+  void findSlots(const google::protobuf::Value &value, Path &path) {
+    if (value.has_struct_value()) {
+      for (auto &[key, field] : value.struct_value().fields()) {
+        path.push_back(key);
+        findSlots(field, path);
+        path.pop_back();
+      }
+    } else if (value.has_list_value()) {
+      for (int i = 0; i < value.list_value().values_size(); ++i) {
+        path.push_back(i);
+        findSlots(value.list_value().values(i), path);
+        path.pop_back();
+      }
+    } else if (auto &str = value.string_value(); str.starts_with('\x01')) {
+      size_t slot = 0;
+      auto [end, ec] = std::from_chars(str.data() + 1, str.data() + str.size(), slot);
+      if (ec == std::errc() && end == str.data() + str.size() && slot < _slots.size()) {
+        _slots[slot].path = path;
+      }
+    }
+  }
+
+  Result<Value> eval(Env &env, const Scope &scope) const {
+    auto record = _record;
+    for (auto &slot : _slots) {
+      auto *field = &record;
+      for (auto &step : slot.path) {
+        field = std::visit(
+            [&](const auto &step) -> google::protobuf::Value * {
+              if constexpr (std::is_same_v<std::decay_t<decltype(step)>, std::string>) {
+                return &(*field->mutable_struct_value()->mutable_fields())[step];
+              } else {
+                return field->mutable_list_value()->mutable_values(step);
+              }
+            },
+            step);
+      }
+      if (auto value = toValue(ToStream(env, scope)(slot.operand))) {
+        *field = std::move(*value);
+      } else {
+        return std::unexpected(value.error());
+      }
+    }
+    return record;
+  }
+
+  google::protobuf::Value _record;
+  std::vector<Slot> _slots;
+};
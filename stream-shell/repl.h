@@ -1,14 +1,22 @@
 #pragma once
 
+#include <algorithm>
 #include <condition_variable>
 #include <csignal>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include <google/protobuf/wrappers.pb.h>
 #include <range/v3/all.hpp>
 #include <unistd.h>
+#include "job.h"
+#include "process_stream.h"
+#include "reactor.h"
 #include "stream_parser.h"
 #include "stream_printer.h"
-#include "tokenize.h"
 
 using namespace std::string_view_literals;
 
@@ -26,10 +34,33 @@ struct ProdEnv final : Env {
       return ranges::yield(value);
     });
   }
+  ~ProdEnv() {
+    cancelJobs();
+    joinJobs();
+    for (auto &[name, thread] : _job_threads) {
+      thread.join();
+    }
+  }
 
   StreamFactory getEnv(StreamRef ref) const override {
+    std::unique_lock lock(_mutex);
     if (auto it = _cache.find(ref); it != _cache.end()) {
       return it->second;
+    } else if (auto it = _process_streams.find(ref.name); it != _process_streams.end()) {
+      // Doesn't keep the process stream open
+      return [this, output = it->second](auto) -> Stream {
+        auto stream = output.lock();
+        if (!stream) {
+          return {};
+        }
+        std::unique_lock lock(_mutex);
+        auto &stop = resetStop();
+        lock.unlock();
+        return stream->subscribe([this, &stop] {
+          std::unique_lock lock(_mutex);
+          return stop;
+        });
+      };
     } else if (auto str = std::getenv(ref.name.c_str())) {
       return _cache[ref] = [sv = std::string_view(str)](auto) {
         return sv | ranges::views::split(':') | ranges::views::transform([](auto chunk) {
@@ -53,54 +84,213 @@ struct ProdEnv final : Env {
       if (pwd) {
         chdir(pwd->c_str());
       }
+    } else if (ref.name == "PATH") {
+      // Exported for executable lookup and child processes, which also invalidates cached lookups
+      std::vector<std::string> dirs;
+      ranges::for_each(stream({}), [&](auto result) {
+        if (auto value = result ? std::get_if<google::protobuf::Value>(&*result) : nullptr;
+            value && value->has_string_value()) {
+          dirs.push_back(std::move(*value->mutable_string_value()));
+        }
+      });
+      setenv("PATH", (dirs | ranges::views::join(':') | ranges::to<std::string>).c_str(), 1);
+
+    } else if (ref.name == "STSH_READ_SIZE") {
+      ranges::for_each(stream({}), [&](auto result) {
+        if (auto value = result ? std::get_if<google::protobuf::Value>(&*result) : nullptr;
+            value && value->number_value() >= 1) {
+          _read_size = std::min<double>(value->number_value(), kMaxReadSize);
+        }
+      });
+    } else if (ref.name == "STSH_FLUSH_INTERVAL") {
+      ranges::for_each(stream({}), [&](auto result) {
+        if (auto value = result ? std::get_if<google::protobuf::Value>(&*result) : nullptr;
+            value && value->number_value() >= 0) {
+          _flush_interval = std::chrono::milliseconds(int64_t(value->number_value()));
+        }
+      });
     }
 
+    std::unique_lock lock(_mutex);
     _cache[ref] = std::move(stream);
   }
   bool sleepUntil(std::chrono::steady_clock::time_point t) override {
     std::unique_lock lock(_mutex);
-    _stop = false;
-    for (; !_stop && _cv.wait_until(lock, t) != std::cv_status::timeout;);
-    return !_stop;
+    auto &stop = resetStop();
+    for (; !stop && _cv.wait_until(lock, t) != std::cv_status::timeout;);
+    return !stop;
   }
   ssize_t read(int fd, google::protobuf::BytesValue &bytes) override {
     std::unique_lock lock(_mutex);
-    _stop = false;
+    auto &stop = resetStop();
+    auto read_size = _read_size;
     lock.unlock();
-    bytes.mutable_value()->resize(4096);
-    auto ret = ::read(fd, bytes.mutable_value()->data(), bytes.mutable_value()->size());
-    if (ret > 0) {
-      bytes.mutable_value()->resize(ret);
+    return _reactor.read(fd, *bytes.mutable_value(), read_size, [this, &stop] {
+      std::unique_lock lock(_mutex);
+      return stop;
+    });
+  }
+  void close(int fd) override {
+    _reactor.release(fd);
+    ::close(fd);
+  }
+  StreamRef background(Stream stream) override {
+    auto job = std::make_shared<Job>();
+    std::string name;
+    {
+      std::unique_lock lock(_mutex);
+      name = std::to_string(getpid()) + "-" + std::to_string(++_job_count);
+      _jobs[name] = job;
+    }
+    auto output = processStream(name);
+    joinFinishedJobs();
+
+    // Each job has a thread of its own, since it holds it for as long as its stream lasts
+    std::unique_lock lock(_mutex);
+    _job_threads[name] = std::thread([this, job, name, output, stream = std::move(stream)] mutable {
+      t_job = job;
+      auto stopped = [&] {
+        std::unique_lock lock(_mutex);
+        return job->stop;
+      };
+      for (auto it = ranges::begin(stream); !stopped() && it != ranges::end(stream); ++it) {
+        output->publish(*it);
+      }
+      // Releases the pipeline and closes its process stream before the job is done
+      stream = {};
+      output.reset();
+      t_job = nullptr;
+
+      std::unique_lock lock(_mutex);
+      _jobs.erase(name);
+      _cv.notify_all();
+    });
+    return {name};
+  }
+  bool interrupt(const StreamRef &job) override {
+    {
+      std::unique_lock lock(_mutex);
+      auto it = _jobs.find(job.name);
+      if (it == _jobs.end()) {
+        return false;
+      }
+      it->second->stop = true;
+      _cv.notify_all();
     }
-    lock.lock();
-    return !_stop ? ret : -1;
+    _reactor.wake();
+    return true;
+  }
+  std::shared_ptr<ProcessStream> processStream(std::string name) override {
+    auto stream = std::make_shared<ProcessStream>();
+    std::unique_lock lock(_mutex);
+    std::erase_if(_process_streams, [](auto &entry) { return entry.second.expired(); });
+    _process_streams[std::move(name)] = stream;
+    return stream;
+  }
+
+  // Interval in which script output is written, if not only when the buffer is full
+  std::chrono::milliseconds flushInterval() const { return _flush_interval; }
+
+  /**
+   * Makes the calling thread evaluate a new foreground pipeline, which |interrupt| stops along
+   * with the threads helping to evaluate it.
+   */
+  void startForeground() {
+    auto job = std::make_shared<Job>();
+    std::unique_lock lock(_mutex);
+    _foreground = job;
+    t_job = std::move(job);
   }
 
   void interrupt() {
+    {
+      std::unique_lock lock(_mutex);
+      _stop = true;
+      if (_foreground) {
+        _foreground->stop = true;
+      }
+      _cv.notify_all();
+    }
+    _reactor.wake();
+  }
+
+  void cancelJobs() {
+    {
+      std::unique_lock lock(_mutex);
+      for (auto &[name, job] : _jobs) {
+        job->stop = true;
+      }
+      _cv.notify_all();
+    }
+    _reactor.wake();
+  }
+
+  // Waits for all background jobs to complete
+  void joinJobs() {
     std::unique_lock lock(_mutex);
-    _stop = true;
-    _cv.notify_all();
+    _cv.wait(lock, [this] { return _jobs.empty(); });
   }
 
  private:
+  // Joins the threads of jobs that are done, which only release their state once joined
+  void joinFinishedJobs() {
+    std::vector<std::thread> finished;
+    {
+      std::unique_lock lock(_mutex);
+      std::erase_if(_job_threads, [&](auto &entry) {
+        if (_jobs.contains(entry.first)) {
+          return false;
+        }
+        finished.push_back(std::move(entry.second));
+        return true;
+      });
+    }
+    for (auto &thread : finished) {
+      thread.join();
+    }
+  }
+
+  // Interruption of the job evaluated by the calling thread, or else of anything evaluated outside
+  // of a job, which is reset by each blocking call. Guarded by |_mutex|
+  bool &resetStop() const {
+    if (t_job) {
+      return t_job->stop;
+    }
+    _stop = false;
+    return _stop;
+  }
+
   void load(std::string path) {
     std::ifstream config(path + "/stream-shell/config.st", std::ios::in);
     if (!config.is_open()) {
       return;
     }
-    _config = (std::stringstream() << config.rdbuf()).view() | ranges::views::split('\n') |
-              ranges::views::filter(ranges::distance) | ranges::to<std::vector<std::string>>;
-    for (auto &line : _config) {
-      (void)_parser->parse(tokenize(line));
+    for (std::string line; std::getline(config, line);) {
+      if (!line.empty()) {
+        (void)_parser->parse(std::string_view(line));
+      }
     }
   }
 
-  std::vector<std::string> _config;
   std::unique_ptr<StreamParser> _parser = makeStreamParser(*this);
   mutable std::map<StreamRef, StreamFactory, std::less<>> _cache;
   std::condition_variable _cv;
-  std::mutex _mutex;
-  bool _stop = false;
+  mutable std::mutex _mutex;
+  mutable bool _stop = false;
+  // Each running binary may buffer a chunk of up to this size
+  static constexpr size_t kMaxReadSize = 16 * 1024 * 1024;
+  size_t _read_size = 64 * 1024;
+  std::chrono::milliseconds _flush_interval{0};
+  std::map<std::string, std::shared_ptr<Job>, std::less<>> _jobs;
+  // The pipeline evaluated by the REPL, if any
+  std::shared_ptr<Job> _foreground;
+  std::map<std::string, std::weak_ptr<ProcessStream>, std::less<>> _process_streams;
+  size_t _job_count = 0;
+  // Threads of background jobs, by name, including finished ones until they're joined
+  std::map<std::string, std::thread, std::less<>> _job_threads;
+  // Reads child process output. Blocked readers are woken by interruptions, after |_mutex| is
+  // released, since they check whether they're stopped while holding its own lock
+  Reactor _reactor;
 };
 
 static ProdEnv *s_env = nullptr;
@@ -110,9 +300,54 @@ inline void repl(Prompt prompt) {
   s_env = &env;
   auto parser = makeStreamParser(env);
 
+  // Writes to a child process that exited are reported as EPIPE by the stdin writer instead
+  std::signal(SIGPIPE, SIG_IGN);
+
   for (const char *line; (line = prompt("stream-shell v0.1 🚀> "));) {
+    env.startForeground();
     std::signal(SIGINT, [](int) { s_env->interrupt(); });
-    printStream(parser->parse(tokenize(std::string_view(line))), [&](auto s) { return prompt(s); });
+    printStream(parser->parse(std::string_view(line)), [&](auto s) { return prompt(s); });
     std::signal(SIGINT, nullptr);
   }
+  // Before the parser, which jobs may refer to, is destroyed
+  env.cancelJobs();
+  env.joinJobs();
+}
+
+/**
+ * Evaluates each line of |script| without prompting, writing output in bulk. |args| are available
+ * as $0, $1, etc, and all but $0 as $*. Returns non-zero if any line failed.
+ */
+inline int runScript(std::istream &script, std::vector<std::string> args) {
+  ProdEnv env;
+  auto parser = makeStreamParser(env);
+
+  auto strings = [](auto begin, auto end) -> StreamFactory {
+    return [strs = std::make_shared<std::vector<std::string>>(begin, end)](auto) {
+      return ranges::views::iota(size_t(0), strs->size()) |
+             ranges::views::transform([strs](size_t i) -> Result<Value> {
+               google::protobuf::Value value;
+               value.set_string_value((*strs)[i]);
+               return value;
+             });
+    };
+  };
+  for (size_t i = 0; i < args.size(); ++i) {
+    env.setEnv({std::to_string(i)}, strings(args.begin() + i, args.begin() + i + 1));
+  }
+  env.setEnv({"*"}, strings(args.begin() + std::min<size_t>(args.size(), 1), args.end()));
+
+  std::signal(SIGPIPE, SIG_IGN);
+
+  auto status = 0;
+  for (std::string line; std::getline(script, line);) {
+    if (line.empty() || line.starts_with("#!")) {
+      continue;
+    }
+    if (!writeStream(parser->parse(std::string_view(line)), STDOUT_FILENO, env.flushInterval())) {
+      status = 1;
+    }
+  }
+  env.joinJobs();
+  return status;
 }
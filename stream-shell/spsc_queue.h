@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/**
+ * Bounded queue between exactly one producer and one consumer thread. Pushing and popping don't
+ * lock unless the queue is full or empty respectively, in which case the caller sleeps until the
+ * other side catches up. Either side may close the queue: the producer once it's done, after which
+ * the consumer drains what's left, or the consumer when it no longer wants values, after which
+ * pushes fail.
+ */
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) : _slots(capacity + 1) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /**
+   * Waits for space for |value|. Returns false, dropping |value|, if the queue is closed.
+   */
+  bool push(T value) {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    auto next = (tail + 1) % _slots.size();
+    if (next == _head.load(std::memory_order_acquire)) {
+      wait([&] { return next != _head.load(std::memory_order_acquire); });
+    }
+    if (_closed.load(std::memory_order_acquire)) {
+      return false;
+    }
+    _slots[tail] = std::move(value);
+    _tail.store(next, std::memory_order_seq_cst);
+    wake();
+    return true;
+  }
+
+  /**
+   * Waits for the next value, or nothing once the queue is closed and drained.
+   */
+  std::optional<T> pop() {
+    auto head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      wait([&] { return head != _tail.load(std::memory_order_acquire); });
+      if (head == _tail.load(std::memory_order_acquire)) {
+        return std::nullopt;
+      }
+    }
+    auto value = std::move(_slots[head]);
+    _slots[head].reset();
+    _head.store((head + 1) % _slots.size(), std::memory_order_seq_cst);
+    wake();
+    return value;
+  }
+
+  void close() {
+    _closed.store(true, std::memory_order_seq_cst);
+    std::lock_guard lock(_mutex);
+    _cv.notify_all();
+  }
+
+ private:
+  // Sleeps until |ready| or the queue is closed
+  void wait(auto ready) {
+    _waiting.fetch_add(1, std::memory_order_seq_cst);
+    std::unique_lock lock(_mutex);
+    _cv.wait(lock, [&] { return ready() || _closed.load(std::memory_order_seq_cst); });
+    _waiting.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Wakes the other side if it's sleeping. Locking orders the notification after its last check
+  void wake() {
+    if (_waiting.load(std::memory_order_seq_cst)) {
+      std::lock_guard lock(_mutex);
+      _cv.notify_all();
+    }
+  }
+
+  // One more than the capacity, so that a full queue can be told apart from an empty one
+  std::vector<std::optional<T>> _slots;
+  // Next slot to pop, written by the consumer
+  alignas(64) std::atomic<size_t> _head = 0;
+  // Next slot to push, written by the producer
+  alignas(64) std::atomic<size_t> _tail = 0;
+  std::atomic<bool> _closed = false;
+  std::atomic<int> _waiting = 0;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+};
@@ -1,34 +1,45 @@
 #include "stream_parser.h"
 
+#include <algorithm>
+#include <charconv>
 #include <expected>
-#include <filesystem>
 #include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
 #include <stack>
-#include <fcntl.h>
+#include <string>
+#include <unordered_map>
 #include <google/protobuf/any.pb.h>
 #include <google/protobuf/struct.pb.h>
 #include <google/protobuf/util/json_util.h>
 #include <range/v3/algorithm/for_each.hpp>
 #include <range/v3/all.hpp>
-#include <stdlib.h>
-#include <sys/ioctl.h>
-#include <termios.h>
 #include <unistd.h>
-#include <utmp.h>
 #include "builtin.h"
+#include "child_process.h"
 #include "config.h"
+#include "executables.h"
 #include "lift.h"
 #include "operand.h"
 #include "operand_op.h"
+#include "parallel.h"
+#include "plan.h"
+#include "record_template.h"
 #include "scope.h"
 #include "to_stream.h"
 #include "to_string.h"
+#include "to_value.h"
+#include "tokenize.h"
 #include "util/trim.h"
 
 namespace {
 
 using namespace std::string_view_literals;
 
+using BidirectionalToken = ranges::any_view<const char, ranges::category::bidirectional>;
+
 #if 0
 
 inline auto lookupType(std::string_view name) {
@@ -38,18 +49,6 @@ inline auto lookupType(std::string_view name) {
 
 #endif
 
-inline auto exec(std::string cmd, std::vector<std::string> args) {
-  if (cmd.starts_with('^')) {
-    cmd.erase(cmd.begin());
-  }
-  auto argv =
-      ranges::views::concat(ranges::views::single(cmd.data()),
-                            args | ranges::views::transform([](auto &s) { return s.data(); }),
-                            ranges::views::single(nullptr)) |
-      ranges::to<std::vector>;
-  return execvp(cmd.data(), argv.data());
-}
-
 auto errorStream(Error err) -> Stream {
   return ranges::views::single(std::unexpected(err));
 }
@@ -63,23 +62,81 @@ template <typename T>
 struct ValueVisitor {
   Result<T> operator()(const google::protobuf::BytesValue &value) { return value; }
   Result<T> operator()(const google::protobuf::Value &value) { return value; }
+  Result<T> operator()(const google::protobuf::Int64Value &value) { return value; }
   Result<T> operator()(const google::protobuf::Any &value) { return value; }
+  Result<T> operator()(const ChunkStream &value) { return value; }
   Result<T> operator()(const auto &) { return std::unexpected(Error::kParseError); }
 };
 
 struct CommandBuilder {
+  /**
+   * A builtin operator stage, fused with subsequent ones into a single Plan.
+   */
+  struct Stage {
+    Scope scope;
+    std::vector<Operand> operands;
+  };
+  struct StageConfig {
+    std::string cmd;
+    CommandConfig config;
+  };
+
   Scope scope;
 
   StreamFactory upstream;
+  std::vector<Stage> stages;
   std::vector<Operand> operands;
 
   StreamFactory closure;
+  // Operands of `par`, if the closure is applied in parallel, and how to instantiate it again
+  std::optional<std::vector<Operand>> parallel;
+  std::function<Result<StreamFactory>()> make_closure;
+
+  // Whether the input passed to the factory is the output of another stage
+  bool has_input = false;
+  // Executables are only given a terminal when their output is printed directly
+  ExecMode exec_mode = ExecMode::kPipe;
 
   // todo: mutex with closure?
   std::string record_literal;
+  // Operands evaluated each time the record literal is, in place of placeholders in its JSON
+  std::vector<Operand> record_slots;
 
   StreamFactory factory(Env &env) && {
-    if (closure) {
+    // Configs are built here if constant, instead of for each input stream
+    std::vector<StageConfig> stage_configs;
+    for (auto &stage : stages) {
+      stage_configs.push_back(
+          {*frontCommand(stage.scope, stage.operands[0]),
+           CommandConfig(env, {stage.operands.begin() + 1, stage.operands.end()})});
+    }
+
+    if (closure && !stage_configs.empty()) {
+      // Builtin stages fused into the closure's stage run before it
+      upstream = [upstream = std::move(upstream),
+                  stage_configs = std::move(stage_configs)](Stream input) -> Stream {
+        auto plan = toPlan(stage_configs);
+        if (!plan) {
+          return ranges::yield(std::unexpected(plan.error()));
+        }
+        return std::move(*plan).run(upstream ? upstream(std::move(input)) : std::move(input));
+      };
+    }
+
+    if (closure && parallel) {
+      assert(upstream);
+      return [upstream = std::move(upstream),
+              closure = std::move(closure),
+              make_closure = std::move(make_closure),
+              config = CommandConfig(env, {parallel->begin() + 1, parallel->end()})](
+                 Stream input) -> Stream {
+        auto shared = config();
+        if (!shared) {
+          return ranges::yield(std::unexpected(shared.error()));
+        }
+        return parallelMap(upstream(std::move(input)), closure, make_closure, **shared);
+      };
+    } else if (closure) {
       assert(upstream);
       return [upstream = std::move(upstream), closure = std::move(closure)](Stream input) {
         return upstream(std::move(input)) | ranges::views::for_each([=](Result<Value> result) {
@@ -87,25 +144,58 @@ struct CommandBuilder {
                });
       };
     }
+    has_input = has_input || upstream;
+
+    auto *cmd = !operands.empty() ? frontCommand(scope, operands[0]) : nullptr;
+    auto config = cmd ? std::optional(CommandConfig(env, {operands.begin() + 1, operands.end()}))
+                      : std::nullopt;
+
     return [&env,
             upstream = std::move(upstream),
             scope = std::move(scope),
-            operands = std::move(operands)](Stream input) -> Stream {
+            stage_configs = std::move(stage_configs),
+            operands = std::move(operands),
+            config = std::move(config),
+            has_input = has_input,
+            exec_mode = exec_mode](Stream input) -> Stream {
       return ranges::yield(upstream ? upstream(std::move(input)) : std::move(input)) |
-             ranges::views::for_each([&env, scope, operands](Stream input) -> Stream {
+             ranges::views::for_each([&env, scope, stage_configs, operands, config, has_input,
+                                      exec_mode](Stream input) -> Stream {
                if (operands.empty()) {
                  return {};
                }
 
+               auto plan = toPlan(stage_configs);
+               if (!plan) {
+                 return ranges::yield(std::unexpected(plan.error()));
+               }
+
                if (auto cmd = frontCommand(scope, operands[0])) {
-                 if (auto config = toConfig(env, std::span{operands}.subspan(1)); !config) {
-                   return ranges::yield(std::unexpected(config.error()));
+                 if (isStreamsBuiltin(*cmd)) {
+                   auto inputs = operands | ranges::views::drop(1) |
+                                 ranges::views::transform(ToStream(env, scope)) |
+                                 ranges::to<std::vector>;
+                   if (has_input) {
+                     inputs.insert(inputs.begin(), std::move(*plan).run(std::move(input)));
+                   }
+                   return runStreamsBuiltin(*cmd, std::move(inputs));
+                 }
+
+                 auto shared = (*config)();
+                 if (!shared) {
+                   return ranges::yield(std::unexpected(shared.error()));
 
-                 } else if (auto stream = runBuiltin(*cmd, *config, input, env)) {
+                 } else if (auto op = builtinOperator(*cmd, *shared)) {
+                   plan->ops.push_back(std::move(*op));
+                   return std::move(*plan).run(std::move(input));
+                 }
+
+                 input = std::move(*plan).run(std::move(input));
+                 if (auto stream = runBuiltin(*cmd, **shared, input, env)) {
                    return *stream;
 
                  } else if (isExecutableInPath(*cmd)) {
-                   return runChildProcess(*cmd, *config, input, env);
+                   return runChildProcess(*cmd, **shared, exec_mode, has_input, input, env);
                  }
                }
 
@@ -115,6 +205,22 @@ struct CommandBuilder {
     };
   }
 
+  /**
+   * Whether this command can be fused into the Plan of the stage it is piped into.
+   */
+  bool isOperatorStage() const {
+    auto *cmd = !closure && !operands.empty() ? frontCommand(scope, operands[0]) : nullptr;
+    return cmd && isBuiltinOperator(*cmd);
+  }
+
+  /**
+   * Whether this command is `par`, applying the closure that follows in parallel.
+   */
+  bool isParallelStage() const {
+    auto *cmd = !closure && !operands.empty() ? frontCommand(scope, operands[0]) : nullptr;
+    return cmd && *cmd == "par";
+  }
+
   Stream build(Env &env) && { return std::move(*this).factory(env)(Stream()); }
   Operand operand(Env &env) && {
     if (operands.size() == 1) {
@@ -133,98 +239,16 @@ struct CommandBuilder {
     return nullptr;
   }
 
-  static Stream runChildProcess(std::string_view cmd,
-                                const google::protobuf::Struct &config,
-                                Stream input,
-                                Env &env) {
-#if !__EMSCRIPTEN__
-
-    auto pty_fd = posix_openpt(O_RDWR | O_NOCTTY);
-    if (pty_fd < 0 || grantpt(pty_fd) < 0 || unlockpt(pty_fd) < 0) {
-      return ranges::yield(std::unexpected(Error::kExecPipeError));
-    }
-
-    const char *tty_name = ptsname(pty_fd);
-    if (!tty_name) {
-      close(pty_fd);
-      return ranges::yield(std::unexpected(Error::kExecPipeError));
-    }
-
-    if (auto pid = fork(); pid == 0) {
-      // Child process
-      int tty_fd = open(tty_name, O_RDWR);
-      if (tty_fd < 0) _exit(1);
-
-      if (setsid() == -1 || ioctl(tty_fd, TIOCSCTTY, 0) == -1 ||
-          tcsetpgrp(tty_fd, getpid()) == -1) {
-        close(tty_fd);
-        _exit(1);
+  static Result<Plan> toPlan(std::span<const StageConfig> stages) {
+    Plan plan;
+    for (auto &[cmd, config] : stages) {
+      auto shared = config();
+      if (!shared) {
+        return std::unexpected(shared.error());
       }
-
-      dup2(tty_fd, STDIN_FILENO);
-      dup2(tty_fd, STDOUT_FILENO);
-      dup2(tty_fd, STDERR_FILENO);
-
-      close(pty_fd);
-      close(tty_fd);
-
-      exec(std::string(cmd), toArgs(config));
-      _exit(1);
-
-    } else if (pid > 0) {
-      tcsetpgrp(pty_fd, pid);
-
-      // Parent process
-      return ranges::views::generate(
-                 [&env, pty_fd, pid, bytes = google::protobuf::BytesValue()] mutable
-                 -> std::optional<Result<Value>> {
-                   if (auto n = env.read(pty_fd, bytes); n == 0) {
-                     close(pty_fd);
-
-                     int status = 0;
-                     waitpid(pid, &status, 0);
-                     tcsetpgrp(STDIN_FILENO, getpgrp());
-
-                     if (status != 0) {
-                       return std::unexpected(Error::kExecNonZeroStatus);
-                     }
-                     return std::nullopt;
-                   } else if (n < 0) {
-                     return std::unexpected(Error::kExecReadError);
-                   } else {
-                     return bytes;
-                   }
-                 }) |
-             ranges::views::take_while([](const auto &value) { return value.has_value(); }) |
-             ranges::views::transform([](auto &&value) { return std::move(*value); });
+      plan.ops.push_back(*builtinOperator(cmd, *shared));
     }
-    return ranges::yield(std::unexpected(Error::kExecForkError));
-#else
-    return ranges::yield(std::unexpected(Error::kExecError));
-#endif
-  }
-
-  static bool isExecutable(const std::filesystem::path &p) {
-    return std::filesystem::is_regular_file(p) && (access(p.c_str(), X_OK) == 0);
-  }
-
-  static bool isExecutableInPath(std::string_view cmd) {
-    auto path = std::filesystem::path{cmd};
-
-    if (std::ranges::contains(path.string(), '/')) {
-      return isExecutable(path);
-    }
-
-    const char *path_env = std::getenv("PATH");
-    if (!path_env) {
-      return false;
-    }
-    return ranges::count_if(std::string_view(path_env) | ranges::views::split(':') |
-                                ranges::views::transform(std::views::common) |
-                                ranges::views::transform([&](auto dir) {
-                                  return std::filesystem::path{dir.begin(), dir.end()} / path;
-                                }),
-                            isExecutable);
+    return plan;
   }
 };
 
@@ -237,7 +261,7 @@ auto unaryLeftOp(bool unary, std::ranges::range auto op) {
 }
 
 auto unaryRightOp(bool unary, std::ranges::range auto op) {
-  if ((op == "&") && unary) return 1;
+  if ((op == "&") && unary) return 2;
   if ((op == "..") && unary) return 7;
   return 0;
 }
@@ -277,8 +301,8 @@ std::optional<std::string_view> ternaryMatch(std::ranges::range auto op) {
 }
 
 /**
- * Used at record-end evaluation to join all operands into a range of json-parsable tokens. These
- * are joined and parsed into a Value struct.
+ * Used to serialize the literal operands and keys of a record literal into json-parsable tokens.
+ * These are joined and parsed into a Value struct.
  */
 struct ToJSON {
   ToJSON(Env &env, Scope scope) : _to_str{env, std::move(scope)} {}
@@ -286,34 +310,14 @@ struct ToJSON {
   auto operator()(const google::protobuf::Message &val) const -> Result<std::string> {
     return _to_str(val);
   }
+  auto operator()(const google::protobuf::Int64Value &val) const -> Result<std::string> {
+    return _to_str(val);
+  }
   auto operator()(const Stream &stream) const -> Result<std::string> {
-    return ranges::fold_left(
-               Stream(stream),
-               google::protobuf::Value(),
-               [&](Result<google::protobuf::Value> &&list, auto &&result) {
-                 return std::move(list).and_then([&](auto &&list) {
-                   return std::move(result).transform([&](auto &&value) -> google::protobuf::Value {
-                     auto &item = *list.mutable_list_value()->add_values();
-
-                     if (auto *bytes = std::get_if<google::protobuf::BytesValue>(&value)) {
-                       // todo: base64 encode
-                       item.set_string_value(bytes->Utf8DebugString());
-                     } else if (auto *pvalue = std::get_if<google::protobuf::Value>(&value)) {
-                       item = std::move(*pvalue);
-                     } else if (auto *any = std::get_if<google::protobuf::Any>(&value)) {
-                       // todo: something
-                       item.set_string_value(any->Utf8DebugString());
-                     }
-                     return list;
-                   });
-                 });
-               })
-        .and_then([&](auto &&list) {
-          if (list.list_value().values_size() == 1) {
-            return (*this)(list.list_value().values(0));
-          }
-          return (*this)(std::forward<decltype(list)>(list));
-        });
+    return toValue(stream).and_then([&](auto &&value) { return (*this)(value); });
+  }
+  auto operator()(const ChunkStream &chunks) const -> Result<std::string> {
+    return (*this)(unchunk(chunks));
   }
   auto operator()(const StreamRef &ref) const -> Result<std::string> { return _to_str(this, ref); }
 
@@ -324,18 +328,117 @@ struct ToJSON {
   ToString::Operand _to_str;
 };
 
-std::optional<Error> appendRecordLiteral(Env &env, CommandBuilder &cmd, Token token) {
-  if (auto str = lift(cmd.operands | ranges::views::transform(ToJSON(env, cmd.scope)))
-                     .transform([](auto &&s) {
-                       return s | ranges::views::join | ranges::to<std::string>;
-                     })) {
-    cmd.operands.clear();
-    cmd.record_literal += *str;
+constexpr bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
 
-  } else {
-    return str.error();
+/**
+ * Whether |str| is a number by the JSON grammar, e.g. not 01, 1. or .1, which are words.
+ */
+bool isJsonNumber(std::string_view str) {
+  auto digits = [&] {
+    auto n = std::ranges::find_if_not(str, isDigit) - str.begin();
+    str.remove_prefix(n);
+    return n;
+  };
+  auto skip = [&](std::string_view chars) {
+    auto found = !str.empty() && chars.contains(str.front());
+    str.remove_prefix(found);
+    return found;
+  };
+
+  skip("-");
+  if (str.starts_with('0')) {
+    str.remove_prefix(1);
+  } else if (!digits()) {
+    return false;
+  }
+  if (skip(".") && !digits()) {
+    return false;
+  }
+  if (skip("eE")) {
+    skip("+-");
+    if (!digits()) {
+      return false;
+    }
+  }
+  return str.empty();
+}
+
+/**
+ * Parses |token| if it's a JSON literal: a number, a double-quoted string, true, false or null.
+ * Words are told apart by their first character without being copied, and only strings with
+ * escapes are parsed as JSON.
+ */
+std::optional<google::protobuf::Value> toLiteral(ranges::bidirectional_range auto token) {
+  google::protobuf::Value val;
+  if (ranges::empty(token)) {
+    return {};
+  } else if (ranges::equal(token, "true"sv) || ranges::equal(token, "false"sv)) {
+    val.set_bool_value(ranges::front(token) == 't');
+    return val;
+  } else if (ranges::equal(token, "null"sv)) {
+    val.set_null_value({});
+    return val;
+  }
+
+  auto first = ranges::front(token);
+  if (first != '"' && first != '-' && !isDigit(first)) {
+    return {};
+  }
+  auto str = token | ranges::to<std::string>;
+
+  if (first != '"') {
+    double number = 0;
+    if (!isJsonNumber(str) ||
+        std::from_chars(str.data(), str.data() + str.size(), number).ec != std::errc()) {
+      return {};
+    }
+    val.set_number_value(number);
+    return val;
   }
 
+  auto is_plain = [](char c) {
+    return c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20;
+  };
+  if (str.size() >= 2 && str.back() == '"' &&
+      std::ranges::all_of(std::string_view(str).substr(1, str.size() - 2), is_plain)) {
+    val.set_string_value(str.substr(1, str.size() - 2));
+    return val;
+  } else if (google::protobuf::util::JsonStringToMessage(str, &val).ok()) {
+    return val;
+  }
+  return {};
+}
+
+/**
+ * Whether |operand| is a value, as opposed to a stream that is evaluated each time the record
+ * literal it's part of is.
+ */
+bool isLiteral(const Operand &operand) {
+  return std::visit(
+      [](const auto &op) {
+        return std::is_base_of_v<google::protobuf::Message, std::decay_t<decltype(op)>>;
+      },
+      operand);
+}
+
+std::optional<Error> appendRecordLiteral(Env &env, CommandBuilder &cmd, Token token) {
+  // Keys are part of the structure of the record, so they are evaluated up front
+  auto is_key = ranges::starts_with(token, ":"sv);
+
+  for (auto &operand : cmd.operands) {
+    if (!isLiteral(operand) && !(is_key && &operand == &cmd.operands.back())) {
+      cmd.record_literal += RecordTemplate::placeholder(cmd.record_slots.size());
+      cmd.record_slots.push_back(std::move(operand));
+    } else if (auto str = ToJSON(env, cmd.scope)(operand)) {
+      cmd.record_literal += *str;
+    } else {
+      return str.error();
+    }
+  }
+  cmd.operands.clear();
+
   cmd.record_literal += token | ranges::to<std::string>;
 
   return {};
@@ -348,10 +451,27 @@ struct StreamParserImpl final : StreamParser {
 
   auto parse(ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>>)
       -> Stream override;
+  auto parse(std::string_view source) -> Stream override;
 
  private:
   using OpPred = std::function<bool(Token)>;
 
+  // Number of distinct pure sources whose parsed commands are kept for reuse
+  static constexpr size_t kMaxCachedSources = 256;
+
+  struct CachedSource {
+    // Owns the text the command's tokens refer to
+    std::shared_ptr<const std::string> source;
+    StreamFactory factory;
+  };
+
+  auto parseFactory(
+      ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>>)
+      -> Result<StreamFactory>;
+  auto parseClosure(std::span<const BidirectionalToken> body, const Scope &scope)
+      -> Result<StreamFactory>;
+  auto parseToken(BidirectionalToken token) -> Result<void>;
+
   auto toOperand(ranges::bidirectional_range auto token) -> std::optional<Operand>;
 
   auto performOp(const OpPred &pred) -> Result<void>;
@@ -359,154 +479,266 @@ struct StreamParserImpl final : StreamParser {
   Env &env;
   std::stack<CommandBuilder> cmds;
   std::stack<Token> ops;
+
+  // Whether the command being parsed has no side effects and doesn't read the environment
+  bool pure = true;
+  // Open parallel closures, by the number of open operators and where their tokens begin
+  std::stack<std::pair<size_t, size_t>> parallel_closures;
+  // Tokens of the outermost open parallel closure
+  std::vector<BidirectionalToken> closure_tokens;
+  // Source of the command being parsed, if owned by the parser rather than the caller. Kept alive
+  // by parallel closures, which parse their tokens again for each instance
+  std::shared_ptr<const std::string> source;
+  // Commands parsed from pure sources, most recently used first, and by their source
+  std::list<CachedSource> cached;
+  std::unordered_map<std::string_view, std::list<CachedSource>::iterator> cached_by_source;
 };
 
 auto StreamParserImpl::parse(
     ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>> tokens)
     -> Stream {
+  auto factory = parseFactory(std::move(tokens));
+  return factory ? (*factory)(Stream()) : errorStream(factory.error());
+}
+
+auto StreamParserImpl::parse(std::string_view text) -> Stream {
+  if (auto it = cached_by_source.find(text); it != cached_by_source.end()) {
+    cached.splice(cached.begin(), cached, it->second);
+    return it->second->factory(Stream());
+  }
+  // Tokenizes a copy, since the parsed command may refer to it after |text| is gone
+  source = std::make_shared<const std::string>(text);
+  auto factory = parseFactory(tokenize(*source));
+  auto owned = std::exchange(source, nullptr);
+  if (!factory) {
+    return errorStream(factory.error());
+  }
+  if (pure) {
+    cached.push_front({std::move(owned), *factory});
+    cached_by_source[*cached.front().source] = cached.begin();
+    if (cached.size() > kMaxCachedSources) {
+      cached_by_source.erase(*cached.back().source);
+      cached.pop_back();
+    }
+  }
+  return (*factory)(Stream());
+}
+
+auto StreamParserImpl::parseFactory(
+    ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>> tokens)
+    -> Result<StreamFactory> {
   // reset state
   cmds = {};
   ops = {};
   cmds.emplace();
+  pure = true;
+  parallel_closures = {};
+  closure_tokens.clear();
 
   for (auto token : tokens) {
-    if (isOperator(cmds.top(), token)) {
-      auto ternary_op = ternaryMatch(token);
-
-      if (auto res = performOp([&](auto op) mutable {
-            if (ternary_op) {
-              return op != *ternary_op;
-            }
-            auto a = precedence(cmds.top(), op);
-            auto b = precedence(cmds.top(), token);
-            return a >= b;
-          });
-          !res.has_value()) {
-        return errorStream(res.error());
-      }
+    if (auto res = parseToken(std::move(token)); !res) {
+      return std::unexpected(res.error());
+    }
+  }
 
-      if (ternary_op) {
-        if (ops.empty()) {
-          return errorStream(Error::kMissingTernary);
-        }
-        ops.pop();
-      }
-      ops.push(token);
-      auto &lhs = cmds.top();
-      auto &rhs = cmds.emplace();
+  if (auto res = performOp([&](const auto &) { return true; }); !res.has_value()) {
+    return std::unexpected(res.error());
+  }
+  if (cmds.size() != 1) {
+    return std::unexpected(Error::kParseError);
+  }
+  cmds.top().exec_mode = ExecMode::kTerminal;
+  return std::move(cmds.top()).factory(env);
+}
 
-      rhs.scope = lhs.scope;
-      rhs.record_literal = lhs.record_literal;
+auto StreamParserImpl::parseClosure(std::span<const BidirectionalToken> body, const Scope &scope)
+    -> Result<StreamFactory> {
+  cmds = {};
+  ops = {};
+  // As if piped into, so that the braces are parsed as a closure
+  cmds.emplace().scope = scope;
+  ops.push("|"sv);
+  cmds.emplace().scope = scope;
 
-    } else if (cmds.top().closure) {
-      return errorStream(Error::kMissingOperator);
+  if (auto res = parseToken("{"sv); !res) {
+    return std::unexpected(res.error());
+  }
+  for (auto &token : body) {
+    if (auto res = parseToken(token); !res) {
+      return std::unexpected(res.error());
+    }
+  }
+  if (auto res = parseToken("}"sv); !res) {
+    return std::unexpected(res.error());
+  }
+  if (!cmds.top().closure) {
+    return std::unexpected(Error::kInvalidClosureSignature);
+  }
+  return cmds.top().closure;
+}
 
-    } else if (token == "(") {
-      ops.push(token);
-      auto &lhs = cmds.top();
-      auto &rhs = cmds.emplace();
+auto StreamParserImpl::parseToken(BidirectionalToken token) -> Result<void> {
+  if (!parallel_closures.empty()) {
+    closure_tokens.push_back(token);
+  }
 
-      rhs.scope = lhs.scope;
+  if (isOperator(cmds.top(), token)) {
+    auto ternary_op = ternaryMatch(token);
 
-    } else if (token == ")") {
-      if (auto res = performOp([](const auto &op) { return op != "("; }); !res.has_value()) {
-        return errorStream(res.error());
+    if (auto res = performOp([&](auto op) mutable {
+          if (ternary_op) {
+            return op != *ternary_op;
+          }
+          auto a = precedence(cmds.top(), op);
+          auto b = precedence(cmds.top(), token);
+          return a >= b;
+        });
+        !res.has_value()) {
+      return std::unexpected(res.error());
+    }
+
+    if (ternary_op) {
+      if (ops.empty()) {
+        return std::unexpected(Error::kMissingTernary);
       }
       ops.pop();
-      auto rhs = std::move(cmds.top());
-      cmds.pop();
+    }
+    ops.push(token);
+    auto &lhs = cmds.top();
+    auto &rhs = cmds.emplace();
 
-      cmds.top().operands.push_back(std::move(rhs).operand(env));
+    rhs.scope = lhs.scope;
+    rhs.record_literal = lhs.record_literal;
 
-    } else if (token == "{") {
-      // If it looks like a closure, assume it is
-      auto is_closure = !ops.empty() && ops.top() == "|" && cmds.top().operands.empty();
+  } else if (cmds.top().closure) {
+    return std::unexpected(Error::kMissingOperator);
 
-      ops.push(token);
-      auto &lhs = cmds.top();
-      auto &rhs = cmds.emplace();
+  } else if (token == "(") {
+    ops.push(token);
+    auto &lhs = cmds.top();
+    auto &rhs = cmds.emplace();
 
-      rhs.scope = lhs.scope;
+    rhs.scope = lhs.scope;
 
-      if (!is_closure) {
-        rhs.record_literal += "{";
-      }
+  } else if (token == ")") {
+    if (auto res = performOp([](const auto &op) { return op != "("; }); !res.has_value()) {
+      return std::unexpected(res.error());
+    }
+    ops.pop();
+    auto rhs = std::move(cmds.top());
+    cmds.pop();
 
-    } else if (token == "}") {
-      if (auto res = performOp([&](const auto &op) { return op != "{"; }); !res.has_value()) {
-        return errorStream(res.error());
-      }
-      ops.pop();
-      auto rhs = std::move(cmds.top());
-      cmds.pop();
+    cmds.top().operands.push_back(std::move(rhs).operand(env));
 
-      if (rhs.record_literal.empty()) {
-        cmds.top().closure = std::move(rhs).factory(env);
+  } else if (token == "{") {
+    // If it looks like a closure, assume it is
+    auto is_parallel = cmds.top().isParallelStage();
+    auto is_closure = !ops.empty() && ops.top() == "|" &&
+                      (cmds.top().operands.empty() || is_parallel);
 
-      } else {
-        if (auto err = appendRecordLiteral(env, rhs, "}"sv)) {
-          return errorStream(*err);
-        }
-        auto value = google::protobuf::Value();
-        if (!google::protobuf::json::JsonStringToMessage(rhs.record_literal,
-                                                         value.mutable_struct_value())
-                 .ok()) {
-          return errorStream(Error::kJsonError);
-        }
-        cmds.top().operands.push_back(std::move(value));
-      }
+    ops.push(token);
+    auto &lhs = cmds.top();
+    auto &rhs = cmds.emplace();
 
-      // todo: generalize open ternary
-    } else if (token == "?") {
-      ops.push(token);
-      auto &lhs = cmds.top();
-      auto &rhs = cmds.emplace();
+    rhs.scope = lhs.scope;
 
-      rhs.scope = lhs.scope;
-      rhs.record_literal = std::move(lhs.record_literal);
+    if (!is_closure) {
+      rhs.record_literal += "{";
+    } else if (is_parallel) {
+      parallel_closures.emplace(ops.size(), closure_tokens.size());
+    }
 
-    } else if (token == "->") {
-      auto &lhs = cmds.top();
-      auto *var_name = lhs.operands.size() == 1 ? getIfString(lhs.operands[0]) : nullptr;
-      if (!var_name || lhs.upstream) {
-        return errorStream(Error::kInvalidClosureSignature);
-      }
-      lhs.upstream = [var = lhs.scope.add(*var_name)](Stream input) -> Stream {
-        auto results = input | ranges::views::take(1) | ranges::to<std::vector>;
-        if (results.empty() || !results.front()) {
-          return results.empty() ? errorStream(Error::kInvalidClosureSignature)
-                                 : ranges::yield(results.front());
-        }
-        *var = results.front().value();
-        return {};
-      };
-      lhs.operands.clear();
+  } else if (token == "}") {
+    if (auto res = performOp([&](const auto &op) { return op != "{"; }); !res.has_value()) {
+      return std::unexpected(res.error());
+    }
+    auto is_parallel = !parallel_closures.empty() && parallel_closures.top().first == ops.size();
+    ops.pop();
+    auto rhs = std::move(cmds.top());
+    cmds.pop();
 
-    } else if (auto value = toOperand(token)) {
-      cmds.top().operands.push_back(std::move(*value));
+    if (rhs.record_literal.empty()) {
+      rhs.has_input = true;
+      cmds.top().closure = std::move(rhs).factory(env);
+
+      if (is_parallel) {
+        // Each concurrent invocation needs an instance of its own, holding its own parameters
+        auto begin = closure_tokens.begin() + parallel_closures.top().second;
+        cmds.top().make_closure = [&env = env,
+                                   source = source,
+                                   body = std::vector(begin, closure_tokens.end() - 1),
+                                   scope = cmds.top().scope] {
+          StreamParserImpl parser(env);
+          parser.source = source;
+          return parser.parseClosure(body, scope);
+        };
+        cmds.top().parallel = std::move(cmds.top().operands);
+        cmds.top().operands.clear();
+
+        parallel_closures.pop();
+        if (parallel_closures.empty()) {
+          closure_tokens.clear();
+        }
+      }
 
-    } else if (!cmds.top().record_literal.empty()) {
-      if (auto res = performOp([&](const auto &op) { return op != "{"; }); !res.has_value()) {
-        return errorStream(res.error());
+    } else {
+      if (auto err = appendRecordLiteral(env, rhs, "}"sv)) {
+        return std::unexpected(*err);
       }
-      if (auto err = appendRecordLiteral(env, cmds.top(), token)) {
-        return errorStream(*err);
+      auto record = RecordTemplate::parse(
+          env, rhs.scope, rhs.record_literal, std::move(rhs.record_slots));
+      if (!record) {
+        return std::unexpected(record.error());
       }
+      cmds.top().operands.push_back(std::move(*record));
+    }
 
-    } else {
-      auto value = google::protobuf::Value();
-      value.set_string_value(token | ranges::to<std::string>);
-      cmds.top().operands.push_back(std::move(value));
+    // todo: generalize open ternary
+  } else if (token == "?") {
+    ops.push(token);
+    auto &lhs = cmds.top();
+    auto &rhs = cmds.emplace();
+
+    rhs.scope = lhs.scope;
+    rhs.record_literal = std::move(lhs.record_literal);
+
+  } else if (token == "->") {
+    auto &lhs = cmds.top();
+    auto *var_name = lhs.operands.size() == 1 ? getIfString(lhs.operands[0]) : nullptr;
+    if (!var_name || lhs.upstream) {
+      return std::unexpected(Error::kInvalidClosureSignature);
     }
-  }
+    lhs.upstream = [var = lhs.scope.add(*var_name)](Stream input) -> Stream {
+      auto results = input | ranges::views::take(1) | ranges::to<std::vector>;
+      if (results.empty() || !results.front()) {
+        return results.empty() ? errorStream(Error::kInvalidClosureSignature)
+                               : ranges::yield(results.front());
+      }
+      *var = results.front().value();
+      return {};
+    };
+    lhs.operands.clear();
 
-  if (auto res = performOp([&](const auto &) { return true; }); !res.has_value()) {
-    return errorStream(res.error());
-  }
-  if (cmds.size() != 1) {
-    return errorStream(Error::kParseError);
+  } else if (auto value = toOperand(token)) {
+    cmds.top().operands.push_back(std::move(*value));
+
+  } else if (!cmds.top().record_literal.empty()) {
+    if (auto res = performOp([&](const auto &op) { return op != "{"; }); !res.has_value()) {
+      return std::unexpected(res.error());
+    }
+    // Keys are evaluated while parsing
+    auto is_key = ranges::starts_with(token, ":"sv);
+    pure = pure && (!is_key || ranges::all_of(cmds.top().operands, isLiteral));
+    if (auto err = appendRecordLiteral(env, cmds.top(), token)) {
+      return std::unexpected(*err);
+    }
+
+  } else {
+    auto value = google::protobuf::Value();
+    value.set_string_value(token | ranges::to<std::string>);
+    cmds.top().operands.push_back(std::move(value));
   }
-  return std::move(cmds.top()).build(env);
+  return {};
 }
 
 auto StreamParserImpl::toOperand(ranges::bidirectional_range auto token) -> std::optional<Operand> {
@@ -520,6 +752,7 @@ auto StreamParserImpl::toOperand(ranges::bidirectional_range auto token) -> std:
     return ranges::yield(lift(trim(token, 1, 1) | ranges::views::split(' ') |
                               ranges::views::transform([&](auto &&token) -> Result<std::string> {
                                 if (ranges::starts_with(token, "$"sv)) {
+                                  pure = false;
                                   return to_str(StreamRef::fromToken(token));
                                 }
                                 return token | ranges::to<std::string>;
@@ -535,9 +768,8 @@ auto StreamParserImpl::toOperand(ranges::bidirectional_range auto token) -> std:
     val.set_string_value(trim(token, 1, 1) | ranges::to<std::string>);
     return val;
 
-  } else if (google::protobuf::util::JsonStringToMessage(token | ranges::to<std::string>, &val)
-                 .ok()) {
-    return val;
+  } else if (auto literal = toLiteral(token)) {
+    return std::move(*literal);
   }
 
   auto make_bool = [](bool b) {
@@ -588,27 +820,50 @@ auto StreamParserImpl::performOp(const OpPred &pred) -> Result<void> {
     auto lhs = std::move(cmds.top());
     cmds.pop();
 
+    // Decoded once here rather than each time the operation is evaluated
+    auto op = toOp(ops.top() | ranges::to<std::string>);
+
     if (unaryLeftOp(lhs.operands.empty(), ops.top())) {
       if (rhs.operands.empty()) {
         return std::unexpected(Error::kMissingOperand);
+      } else if (!op) {
+        return std::unexpected(Error::kInvalidOp);
       }
-      rhs.operands[0] = std::visit(OperandOp(ops.top()), std::move(rhs.operands[0]));
+      rhs.operands[0] = std::visit(OperandOp(*op), std::move(rhs.operands[0]));
       lhs.operands.append_range(rhs.operands);
       cmds.push(std::move(lhs));
 
+    } else if (op == Op::kBackground) {
+      // Like ;, but without waiting for the command
+      if (lhs.operands.empty()) {
+        return std::unexpected(Error::kMissingOperand);
+      }
+      pure = false;
+      auto job = env.background(std::move(lhs).build(env));
+      if (rhs.operands.empty() && !rhs.upstream) {
+        auto value = google::protobuf::Value();
+        value.set_string_value("$" + job.name);
+        rhs.operands.push_back(std::move(value));
+      }
+      cmds.push(std::move(rhs));
+
     } else if (unaryRightOp(rhs.operands.empty(), ops.top())) {
       if (lhs.operands.empty()) {
         return std::unexpected(Error::kMissingOperand);
+      } else if (!op) {
+        return std::unexpected(Error::kInvalidOp);
       }
-      lhs.operands.back() = std::visit(OperandOp(ops.top()), std::move(lhs.operands.back()));
+      lhs.operands.back() = std::visit(OperandOp(*op), std::move(lhs.operands.back()));
       cmds.push(std::move(lhs));
 
     } else if (binaryOp(ops.top())) {
       if (lhs.operands.empty() || rhs.operands.empty()) {
         return std::unexpected(Error::kMissingOperand);
+      } else if (!op) {
+        return std::unexpected(Error::kInvalidOp);
       }
       rhs.operands[0] = std::visit(
-          OperandOp(ops.top()), std::move(lhs.operands.back()), std::move(rhs.operands[0]));
+          OperandOp(*op), std::move(lhs.operands.back()), std::move(rhs.operands[0]));
       lhs.operands.pop_back();
       lhs.operands.append_range(rhs.operands);
       cmds.push(std::move(lhs));
@@ -622,8 +877,10 @@ auto StreamParserImpl::performOp(const OpPred &pred) -> Result<void> {
 
       if (llhs.operands.empty() || lhs.operands.empty() || rhs.operands.empty()) {
         return std::unexpected(Error::kMissingOperand);
+      } else if (!op) {
+        return std::unexpected(Error::kInvalidOp);
       }
-      rhs.operands[0] = std::visit(OperandOp(ops.top()),
+      rhs.operands[0] = std::visit(OperandOp(*op),
                                    std::move(llhs.operands.back()),
                                    std::move(lhs).operand(env),
                                    std::move(rhs.operands[0]));
@@ -632,10 +889,13 @@ auto StreamParserImpl::performOp(const OpPred &pred) -> Result<void> {
       cmds.push(std::move(llhs));
 
     } else if (ops.top() == ";") {
+      pure = false;
+      lhs.exec_mode = ExecMode::kTerminal;
       ranges::for_each(std::move(lhs).build(env), [](auto &&) {});
       cmds.push(std::move(rhs));
 
     } else if (ops.top() == "=") {
+      pure = false;
       if (lhs.operands.size() != 1) {
         return std::unexpected(Error::kMissingOperand);
       }
@@ -659,7 +919,14 @@ auto StreamParserImpl::performOp(const OpPred &pred) -> Result<void> {
       cmds.push(std::move(lhs));
 
     } else if (ops.top() == "|") {
-      rhs.upstream = std::move(lhs).factory(env);
+      if (lhs.isOperatorStage()) {
+        rhs.upstream = std::move(lhs.upstream);
+        rhs.stages = std::move(lhs.stages);
+        rhs.stages.push_back({std::move(lhs.scope), std::move(lhs.operands)});
+      } else {
+        rhs.upstream = std::move(lhs).factory(env);
+      }
+      rhs.has_input = true;
       cmds.push(std::move(rhs));
 
     } else {
@@ -2,6 +2,7 @@
 
 #include <expected>
 #include <functional>
+#include <memory>
 #include <string_view>
 #include <google/protobuf/any.pb.h>
 #include <google/protobuf/struct.pb.h>
@@ -48,6 +49,7 @@ inline auto operator!=(range auto lhs, std::string_view rhs) {
 
 using Value = std::variant<google::protobuf::BytesValue,  // Bytes
                            google::protobuf::Value,       // Primitives & JSON
+                           google::protobuf::Int64Value,  // Exact integers, e.g. from ranges
                            google::protobuf::Any>;        // Strong types
 
 enum class Error : int {
@@ -95,12 +97,22 @@ struct StreamRef {
   }
 };
 
+class ProcessStream;
+
 struct Env {
   virtual ~Env() = default;
   virtual StreamFactory getEnv(StreamRef) const = 0;
   virtual void setEnv(StreamRef, StreamFactory) = 0;
   virtual bool sleepUntil(std::chrono::steady_clock::time_point) = 0;
   virtual ssize_t read(int fd, google::protobuf::BytesValue &bytes) = 0;
+  // Closes a descriptor that may have been read
+  virtual void close(int fd) = 0;
+  // Evaluates |stream| in the background, returning the process stream that mirrors its output
+  virtual StreamRef background(Stream stream) = 0;
+  // Cancels a background job, interrupting blocking calls made on its behalf
+  virtual bool interrupt(const StreamRef &job) = 0;
+  // Publishes the output of a running pipeline or child process to $<name> while it's referenced
+  virtual std::shared_ptr<ProcessStream> processStream(std::string name) = 0;
 };
 
 struct StreamParser {
@@ -108,6 +120,12 @@ struct StreamParser {
   virtual auto parse(
       ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>>)
       -> Stream = 0;
+  /**
+   * Tokenizes and parses a copy of |source|. Reuses the command parsed from an identical recent
+   * source, unless parsing it had side effects or read the environment, e.g. assignments, |;| or
+   * interpolated backticks, which are parsed again every time.
+   */
+  virtual auto parse(std::string_view source) -> Stream = 0;
 };
 
 /**
@@ -1,13 +1,16 @@
 #include "stream_printer.h"
 
+#include <cerrno>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <string_view>
 #include <google/protobuf/any.pb.h>
 #include <google/protobuf/struct.pb.h>
 #include <google/protobuf/util/json_util.h>
 #include <range/v3/all.hpp>
 #include <unistd.h>
+#include "io_format.h"
 #include "to_string.h"
 
 namespace {
@@ -76,6 +79,52 @@ struct REPLPrinter final : Printer {
   const Prompt &_prompt;
 };
 
+/**
+ * Writes values in the I/O Format, so that output is read back the same by another stage, e.g.
+ * bytes as they are rather than one chunk per line.
+ */
+struct BufferedPrinter final : Consumer {
+  static constexpr size_t kCapacity = 64 * 1024;
+
+  BufferedPrinter(int fd, std::chrono::milliseconds flush_interval)
+      : _fd{fd}, _flush_interval{flush_interval} {
+    _buffer.reserve(kCapacity);
+  }
+  ~BufferedPrinter() { flush(); }
+
+  auto operator()(size_t, const Value &value) -> bool override {
+    if (!serialize(value, _buffer)) {
+      return false;
+    }
+    if (_buffer.size() >= kCapacity ||
+        (_flush_interval.count() &&
+         std::chrono::steady_clock::now() - _last_flush >= _flush_interval)) {
+      return flush();
+    }
+    return true;
+  }
+
+  bool flush() {
+    std::string_view pending = _buffer;
+    while (!pending.empty()) {
+      auto ret = ::write(_fd, pending.data(), pending.size());
+      if (ret < 0 && errno != EINTR) {
+        break;
+      }
+      pending.remove_prefix(std::max<ssize_t>(ret, 0));
+    }
+    _buffer.clear();
+    _last_flush = std::chrono::steady_clock::now();
+    return pending.empty();
+  }
+
+ private:
+  int _fd;
+  std::chrono::milliseconds _flush_interval;
+  std::chrono::steady_clock::time_point _last_flush = std::chrono::steady_clock::now();
+  std::string _buffer;
+};
+
 }  // namespace
 
 void printStream(Stream &&stream, const Prompt &prompt) {
@@ -92,3 +141,17 @@ void printStream(Stream &&stream, const Prompt &prompt) {
     }
   }
 }
+
+bool writeStream(Stream &&stream, int fd, std::chrono::milliseconds flush_interval) {
+  BufferedPrinter printer(fd, flush_interval);
+  for (auto &&[i, result] : ranges::views::enumerate(std::move(stream))) {
+    if (!result) {
+      printer.flush();
+      std::cerr << std::format("Failed with code: {}", int(result.error())) << std::endl;
+      return false;
+    } else if (!printer(i, *result)) {
+      return false;
+    }
+  }
+  return printer.flush();
+}
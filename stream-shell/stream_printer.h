@@ -1,7 +1,15 @@
 #pragma once
 
+#include <chrono>
 #include "stream_parser.h"
 
 using Prompt = std::function<const char *(const char *prompt)>;
 
 void printStream(Stream &&, const Prompt &);
+
+/**
+ * Writes every value of a stream to |fd| in the I/O Format, without prompting, for scripts. Output
+ * is buffered and written when the buffer is full, at the end, or once |flush_interval| passed
+ * since the last write, unless it's zero. Returns false if the stream failed.
+ */
+bool writeStream(Stream &&, int fd, std::chrono::milliseconds flush_interval = {});
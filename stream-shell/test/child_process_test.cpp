@@ -0,0 +1,80 @@
+#include "stream-shell/child_process.h"
+
+#include <csignal>
+#include <future>
+#include <string>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+#include <google/protobuf/wrappers.pb.h>
+#include <range/v3/all.hpp>
+#include "test_env.h"
+
+namespace {
+
+// Reads child process output directly, instead of through a reactor
+struct PipeEnv : TestEnv {
+  ssize_t read(int fd, google::protobuf::BytesValue &bytes) override {
+    auto &buffer = *bytes.mutable_value();
+    buffer.resize(4096);
+    auto n = ::read(fd, buffer.data(), buffer.size());
+    buffer.resize(std::max<ssize_t>(n, 0));
+    return n;
+  }
+};
+
+// Writes to a child that exited fail with EPIPE instead, as in the shell
+struct IgnoreSigpipe {
+  IgnoreSigpipe() { std::signal(SIGPIPE, SIG_IGN); }
+};
+
+// `head -1`, which exits after the first line of its input
+google::protobuf::Struct head() {
+  google::protobuf::Struct config;
+  (*config.mutable_fields())["@"].mutable_list_value()->add_values()->set_number_value(-1);
+  return config;
+}
+
+auto integers() {
+  return ranges::views::iota(0) | ranges::views::transform([](int i) -> Result<Value> {
+           google::protobuf::Int64Value value;
+           value.set_value(i);
+           return value;
+         });
+}
+
+std::string readAll(Stream stream) {
+  std::string bytes;
+  for (auto &&result : stream) {
+    BOOST_REQUIRE(result.has_value());
+    bytes += std::get<google::protobuf::BytesValue>(*result).value();
+  }
+  return bytes;
+}
+
+}  // namespace
+
+BOOST_FIXTURE_TEST_SUITE(child_process_test, IgnoreSigpipe)
+
+BOOST_AUTO_TEST_CASE(infinite_input) {
+  PipeEnv env;
+  BOOST_TEST(readAll(runChildProcess("head", head(), ExecMode::kPipe, true, integers(), env)) ==
+             "0\n");
+}
+
+BOOST_AUTO_TEST_CASE(blocked_input) {
+  PipeEnv env;
+  // Like `tail -f`, the input blocks after its first value until released
+  std::promise<void> release;
+  auto input = integers() | ranges::views::transform(
+                                [released = release.get_future().share()](auto result) {
+                                  if (std::get<google::protobuf::Int64Value>(*result).value()) {
+                                    released.wait();
+                                  }
+                                  return result;
+                                });
+  BOOST_TEST(readAll(runChildProcess("head", head(), ExecMode::kPipe, true, input, env)) ==
+             "0\n");
+  release.set_value();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,4 +14,29 @@ BOOST_AUTO_TEST_CASE(empty) {
   BOOST_TEST(toConfig(env, {}).has_value());
 }
 
+google::protobuf::Value makeString(std::string str) {
+  google::protobuf::Value value;
+  value.set_string_value(std::move(str));
+  return value;
+}
+
+BOOST_AUTO_TEST_CASE(subcommands) {
+  std::vector<Operand> operands = {makeString("commit"), makeString("HEAD")};
+  auto config = toConfig(env, operands);
+  BOOST_REQUIRE(config.has_value());
+  BOOST_TEST(config->fields().at("@").list_value().values_size() == 2);
+  BOOST_TEST(config->fields().at("\"commit\"").struct_value().fields().contains("\"HEAD\""));
+}
+
+BOOST_AUTO_TEST_CASE(constant) {
+  CommandConfig config(env, {makeString("commit")});
+  BOOST_TEST(config()->get() == config()->get());
+}
+
+BOOST_AUTO_TEST_CASE(rebuilt) {
+  CommandConfig config(env, {Stream(ranges::yield(Result<Value>(makeString("commit"))))});
+  BOOST_TEST(config()->get() != config()->get());
+  BOOST_TEST(config().value()->fields().at("@").list_value().values(0).string_value() == "commit");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
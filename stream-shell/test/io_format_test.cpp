@@ -0,0 +1,123 @@
+#include "stream-shell/io_format.h"
+
+#include <boost/test/unit_test.hpp>
+#include <google/protobuf/struct.pb.h>
+#include <range/v3/all.hpp>
+
+using namespace std::string_literals;
+
+BOOST_AUTO_TEST_SUITE(io_format_test)
+
+auto serialized(const Value &value) {
+  std::string out;
+  BOOST_TEST(serialize(value, out));
+  return out;
+}
+
+BOOST_AUTO_TEST_CASE(bytes) {
+  google::protobuf::BytesValue bytes;
+  bytes.set_value("raw\0bytes"s);
+  BOOST_TEST(serialized(bytes) == "raw\0bytes"s);
+}
+
+BOOST_AUTO_TEST_CASE(string) {
+  google::protobuf::Value value;
+  value.set_string_value("foo");
+  BOOST_TEST(serialized(value) == "foo\n");
+}
+
+BOOST_AUTO_TEST_CASE(json) {
+  google::protobuf::Value value;
+  value.set_number_value(42);
+  BOOST_TEST(serialized(value) == "42\n");
+
+  (*value.mutable_struct_value()->mutable_fields())["name"].set_string_value("Albert");
+  BOOST_TEST(serialized(value) == "{\"name\":\"Albert\"}\n");
+}
+
+BOOST_AUTO_TEST_CASE(integer) {
+  google::protobuf::Int64Value value;
+  value.set_value(9007199254740993);
+  BOOST_TEST(serialized(value) == "9007199254740993\n");
+}
+
+BOOST_AUTO_TEST_CASE(delimited) {
+  google::protobuf::Any any;
+  any.set_type_url("type.googleapis.com/google.protobuf.Value");
+  any.set_value(std::string(300, 'x'));
+  BOOST_TEST(serialized(any) == "\xac\x02" + std::string(300, 'x'));
+}
+
+auto bytes(std::string str) {
+  google::protobuf::BytesValue bytes;
+  bytes.set_value(std::move(str));
+  return Value(std::move(bytes));
+}
+
+auto frames(Framer &framer, bool eof = false) {
+  std::vector<std::string> values;
+  for (std::optional<Result<Value>> value; (value = framer.next(eof));) {
+    BOOST_TEST(value->has_value());
+    if (auto *json = std::get_if<google::protobuf::Value>(&**value)) {
+      values.push_back(json->has_string_value() ? json->string_value()
+                                                : std::to_string(int(json->number_value())));
+    } else if (auto *any = std::get_if<google::protobuf::Any>(&**value)) {
+      values.push_back(any->value());
+    }
+  }
+  return values;
+}
+
+using Frames = std::vector<std::string>;
+
+BOOST_AUTO_TEST_CASE(frame_lines) {
+  auto framer = Framer(Framing::kLines);
+  BOOST_TEST(framer.append(bytes("foo\nba")));
+  BOOST_TEST(frames(framer) == Frames({"foo"}), boost::test_tools::per_element());
+  BOOST_TEST(framer.append(bytes("r\r\nbaz")));
+  BOOST_TEST(frames(framer) == Frames({"bar"}), boost::test_tools::per_element());
+  BOOST_TEST(frames(framer, true) == Frames({"baz"}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(frame_json) {
+  auto framer = Framer(Framing::kJson);
+  BOOST_TEST(framer.append(bytes("1\n\n\"two\"\n3")));
+  BOOST_TEST(frames(framer) == Frames({"1", "two"}), boost::test_tools::per_element());
+  BOOST_TEST(frames(framer, true) == Frames({"3"}), boost::test_tools::per_element());
+
+  BOOST_TEST(framer.append(bytes("{ not json\n")));
+  BOOST_TEST(framer.next().value().error() == Error::kJsonError);
+
+  // Values may span lines, and only the malformed line is skipped
+  BOOST_TEST(framer.append(bytes("{\n  \"name\": \"foo\"\n}\n\"bar\"")));
+  auto record = std::get<google::protobuf::Value>(framer.next().value().value());
+  BOOST_TEST(record.struct_value().fields().at("name").string_value() == "foo");
+  BOOST_TEST(frames(framer, true) == Frames({"bar"}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(frame_json_array) {
+  auto framer = Framer(Framing::kJsonArray);
+  BOOST_TEST(framer.append(bytes("[1, \"tw")));
+  BOOST_TEST(frames(framer) == Frames({"1"}), boost::test_tools::per_element());
+  BOOST_TEST(framer.append(bytes("o\", 3]\n4")));
+  BOOST_TEST(frames(framer) == Frames({"two", "3"}), boost::test_tools::per_element());
+  BOOST_TEST(frames(framer, true) == Frames({"4"}), boost::test_tools::per_element());
+
+  BOOST_TEST(framer.append(bytes("[5,")));
+  BOOST_TEST(frames(framer) == Frames({"5"}), boost::test_tools::per_element());
+  BOOST_TEST(framer.next(true).value().error() == Error::kJsonError);
+}
+
+BOOST_AUTO_TEST_CASE(frame_delimited) {
+  auto framer = Framer(Framing::kDelimited);
+  BOOST_TEST(framer.append(bytes("\x03" "foo\xac")));
+  BOOST_TEST(frames(framer) == Frames({"foo"}), boost::test_tools::per_element());
+  BOOST_TEST(framer.append(bytes("\x02" + std::string(300, 'x'))));
+  BOOST_TEST(frames(framer) == Frames({std::string(300, 'x')}), boost::test_tools::per_element());
+
+  BOOST_TEST(framer.append(bytes("\x05" "ab")));
+  BOOST_TEST(frames(framer).empty());
+  BOOST_TEST(framer.next(true).value().error() == Error::kParseError);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+#include "stream-shell/json_scanner.h"
+
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(json_scanner_test)
+
+using Values = std::vector<std::string>;
+
+/**
+ * Appends |input| to what's left of |buffer|, dropping consumed bytes as the framer does, and
+ * returns the scanned values, with errors as "!".
+ */
+Values scan(JsonScanner &scanner, std::string &buffer, std::string_view input, bool eof = false) {
+  auto consumed = scanner.consumed();
+  buffer.erase(0, consumed);
+  scanner.drop(consumed);
+  buffer += input;
+
+  Values values;
+  for (;;) {
+    auto next = scanner.next(buffer, eof);
+    if (next.status == JsonScanner::Status::kPending) {
+      return values;
+    } else if (next.status == JsonScanner::Status::kError) {
+      values.push_back("!");
+    } else {
+      values.push_back(buffer.substr(next.begin, next.end - next.begin));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(values) {
+  JsonScanner scanner;
+  std::string buffer;
+  BOOST_TEST(scan(scanner, buffer, "1\n\n\"two\"\n3") == Values({"1", "\"two\""}),
+             boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, "", true) == Values({"3"}), boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, "true false null", true) == Values({"true", "false", "null"}),
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(nested) {
+  JsonScanner scanner;
+  std::string buffer;
+  BOOST_TEST(scan(scanner, buffer, R"({"a": [1, {"b")").empty());
+  BOOST_TEST(scan(scanner, buffer, R"(: "}\"]"}]}  {})") ==
+                 Values({R"({"a": [1, {"b": "}\"]"}]})", "{}"}),
+             boost::test_tools::per_element());
+
+  // Escapes split across reads
+  BOOST_TEST(scan(scanner, buffer, R"("a\)").empty());
+  BOOST_TEST(scan(scanner, buffer, R"(""")") == Values({R"("a\"")"}),
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(split_arrays) {
+  JsonScanner scanner(true);
+  std::string buffer;
+  BOOST_TEST(scan(scanner, buffer, R"([1, "tw)") == Values({"1"}),
+             boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, R"(o", [3,)") == Values({R"("two")"}),
+             boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, " 4], {\"x\": []}]\n[]\n5") ==
+                 Values({"[3, 4]", R"({"x": []})"}),
+             boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, "", true) == Values({"5"}), boost::test_tools::per_element());
+
+  // Returned elements are dropped while the array is scanned
+  BOOST_TEST(scan(scanner, buffer, "[" + std::string(1000, ' ') + "1, 2").size() == 1);
+  BOOST_TEST(buffer.size() - scanner.consumed() == 1);
+  BOOST_TEST(scan(scanner, buffer, "", true) == Values({"!"}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(errors) {
+  JsonScanner scanner;
+  std::string buffer;
+  // Each malformed line is skipped
+  BOOST_TEST(scan(scanner, buffer, "[1,]\n{\"a\" 1}\n2\n[1}\n3\n") ==
+                 Values({"!", "!", "2", "!", "3"}),
+             boost::test_tools::per_element());
+  BOOST_TEST(scan(scanner, buffer, "{", true) == Values({"!"}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
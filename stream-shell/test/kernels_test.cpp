@@ -0,0 +1,90 @@
+#include "stream-shell/kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernels_test)
+
+using Doubles = std::vector<double>;
+using Ints = std::vector<int64_t>;
+
+// Operands of a single element are broadcast
+auto run(Kernel kernel, const Doubles &lhs, const Doubles &rhs) {
+  auto n = std::max(lhs.size(), rhs.size());
+  Doubles out(n);
+  runKernel(kernel, lhs.data(), lhs.size() > 1, rhs.data(), rhs.size() > 1, out.data(), n);
+  return out;
+}
+
+BOOST_AUTO_TEST_CASE(arithmetic) {
+  Doubles lhs = {1, 2, 3, 4, 5, 6, 7}, rhs = {7, 6, 5, 4, 3, 2, 1};
+  BOOST_TEST(run(Kernel::kAdd, lhs, rhs) == Doubles(7, 8), boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kSub, lhs, {1}) == Doubles({0, 1, 2, 3, 4, 5, 6}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kMul, {2}, lhs) == Doubles({2, 4, 6, 8, 10, 12, 14}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kMod, lhs, {3}) == Doubles({1, 2, 0, 1, 2, 0, 1}),
+             boost::test_tools::per_element());
+  BOOST_TEST(std::isnan(run(Kernel::kMod, {1}, {0})[0]));
+  BOOST_TEST(run(Kernel::kMod, {-0x1p63}, {-1}) == Doubles({0}), boost::test_tools::per_element());
+  BOOST_TEST(std::isnan(run(Kernel::kMod, {1e300}, {7})[0]));
+  BOOST_TEST(std::isnan(run(Kernel::kMod, {NAN}, {7})[0]));
+  BOOST_TEST(std::isnan(run(Kernel::kMod, {7}, {0x1p63})[0]));
+}
+
+BOOST_AUTO_TEST_CASE(comparison) {
+  Doubles lhs = {1, 2, 3, 4, 5, NAN, 7};
+  BOOST_TEST(run(Kernel::kLt, lhs, {4}) == Doubles({1, 1, 1, 0, 0, 0, 0}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kGe, lhs, {4}) == Doubles({0, 0, 0, 1, 1, 0, 1}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kEq, lhs, lhs) == Doubles({1, 1, 1, 1, 1, 0, 1}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kNe, lhs, lhs) == Doubles({0, 0, 0, 0, 0, 1, 0}),
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(logical) {
+  Doubles lhs = {0, 0, 1, 1, 2, 0}, rhs = {0, 1, 0, 1, -1, NAN};
+  BOOST_TEST(run(Kernel::kAnd, lhs, rhs) == Doubles({0, 0, 0, 1, 1, 0}),
+             boost::test_tools::per_element());
+  BOOST_TEST(run(Kernel::kOr, lhs, rhs) == Doubles({0, 1, 1, 1, 1, 1}),
+             boost::test_tools::per_element());
+}
+
+auto runInts(Kernel kernel, const Ints &lhs, const Ints &rhs) -> std::optional<Ints> {
+  auto n = std::max(lhs.size(), rhs.size());
+  Ints out(n);
+  if (!runKernel(kernel, lhs.data(), lhs.size() > 1, rhs.data(), rhs.size() > 1, out.data(), n)) {
+    return {};
+  }
+  return out;
+}
+
+BOOST_AUTO_TEST_CASE(integers) {
+  constexpr auto kMax = std::numeric_limits<int64_t>::max();
+  Ints lhs = {1, 2, 3, 4, 5, 6, 7};
+  BOOST_TEST(*runInts(Kernel::kAdd, lhs, {kMax - 7}) ==
+                 Ints({kMax - 6, kMax - 5, kMax - 4, kMax - 3, kMax - 2, kMax - 1, kMax}),
+             boost::test_tools::per_element());
+  BOOST_TEST(*runInts(Kernel::kMod, {-7}, lhs) == Ints({0, -1, -1, -3, -2, -1, 0}),
+             boost::test_tools::per_element());
+  BOOST_TEST(*runInts(Kernel::kLe, lhs, {4}) == Ints({1, 1, 1, 1, 0, 0, 0}),
+             boost::test_tools::per_element());
+  BOOST_TEST(*runInts(Kernel::kMul, {1 << 30}, {1 << 30}) == Ints({int64_t(1) << 60}),
+             boost::test_tools::per_element());
+
+  // Not exact on integers
+  BOOST_TEST(!runInts(Kernel::kAdd, lhs, {kMax - 6}));
+  BOOST_TEST(!runInts(Kernel::kSub, {-kMax}, {2}));
+  BOOST_TEST(!runInts(Kernel::kMul, {kMax / 2}, {3}));
+  BOOST_TEST(!runInts(Kernel::kMod, lhs, {0}));
+  BOOST_TEST(!runInts(Kernel::kDiv, lhs, {1}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+#include "stream-shell/process_stream.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <range/v3/all.hpp>
+
+BOOST_AUTO_TEST_SUITE(process_stream_test)
+
+Result<Value> number(double n) {
+  google::protobuf::Value value;
+  value.set_number_value(n);
+  return value;
+}
+
+std::vector<double> numbers(Stream stream) {
+  return std::move(stream) | ranges::views::transform([](const Result<Value> &result) {
+           return std::get<google::protobuf::Value>(*result).number_value();
+         }) |
+         ranges::to<std::vector>;
+}
+
+auto never = [] { return false; };
+
+BOOST_AUTO_TEST_CASE(only_new_values) {
+  auto output = std::make_unique<ProcessStream>();
+  output->publish(number(1));
+  auto stream = output->subscribe(never);
+  output->publish(number(2));
+  output->publish(number(3));
+  output.reset();
+
+  BOOST_TEST(numbers(stream) == std::vector<double>({2, 3}), boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(slow_reader_skips_ahead) {
+  auto output = std::make_unique<ProcessStream>();
+  auto stream = output->subscribe(never);
+  for (size_t i = 0; i < 2 * ProcessStream::kCapacity; ++i) {
+    output->publish(number(i));
+  }
+  output.reset();
+
+  auto values = numbers(stream);
+  BOOST_TEST(values.size() == ProcessStream::kCapacity);
+  BOOST_TEST(values.front() == ProcessStream::kCapacity);
+  BOOST_TEST(values.back() == 2 * ProcessStream::kCapacity - 1);
+}
+
+BOOST_AUTO_TEST_CASE(stopped) {
+  ProcessStream output;
+  auto stream = output.subscribe([] { return true; });
+  BOOST_TEST(numbers(stream).empty());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_readers) {
+  auto output = std::make_unique<ProcessStream>();
+  std::vector<std::vector<double>> values(4);
+  std::vector<std::thread> readers;
+  for (auto &values : values) {
+    readers.emplace_back(
+        [&values, stream = output->subscribe(never)] { values = numbers(stream); });
+  }
+  for (auto i = 0; i < 100'000; ++i) {
+    output->publish(number(i));
+  }
+  output.reset();
+  for (auto &reader : readers) {
+    reader.join();
+  }
+
+  // Readers may skip values, but see the rest in order
+  for (auto &values : values) {
+    BOOST_TEST(ranges::adjacent_find(values, std::greater_equal<>()) == values.end());
+    BOOST_TEST(values.back() == 99'999);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,78 @@
+#include "stream-shell/reactor.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(reactor_test)
+
+auto never = [] { return false; };
+
+BOOST_AUTO_TEST_CASE(concurrent_sources) {
+  Reactor reactor;
+  int a[2], b[2];
+  BOOST_REQUIRE(pipe(a) == 0 && pipe(b) == 0);
+
+  // Neither writer is blocked while the other source is read
+  std::thread writer([&] {
+    BOOST_TEST(write(a[1], "a", 1) == 1);
+    BOOST_TEST(write(b[1], "bb", 2) == 2);
+    close(a[1]);
+    close(b[1]);
+  });
+
+  std::string bytes;
+  BOOST_TEST(reactor.read(b[0], bytes, 16, never) == 2);
+  BOOST_TEST(bytes == "bb");
+  BOOST_TEST(reactor.read(b[0], bytes, 16, never) == 0);
+  BOOST_TEST(reactor.read(a[0], bytes, 16, never) == 1);
+  BOOST_TEST(bytes == "a");
+  BOOST_TEST(reactor.read(a[0], bytes, 16, never) == 0);
+  writer.join();
+
+  reactor.release(a[0]);
+  reactor.release(b[0]);
+  close(a[0]);
+  close(b[0]);
+}
+
+BOOST_AUTO_TEST_CASE(max_size) {
+  Reactor reactor;
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  BOOST_TEST(write(fds[1], "abcdef", 6) == 6);
+  close(fds[1]);
+
+  std::string bytes, all;
+  for (ssize_t n; (n = reactor.read(fds[0], bytes, 4, never)) > 0;) {
+    BOOST_TEST(n <= 4);
+    all += bytes;
+  }
+  BOOST_TEST(all == "abcdef");
+
+  reactor.release(fds[0]);
+  close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(stopped) {
+  Reactor reactor;
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+
+  std::atomic<bool> stop = false;
+  std::thread reader([&] {
+    std::string bytes;
+    BOOST_TEST(reactor.read(fds[0], bytes, 16, [&] { return stop.load(); }) == -1);
+  });
+  stop = true;
+  reactor.wake();
+  reader.join();
+
+  reactor.release(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+#include "stream-shell/spsc_queue.h"
+
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(spsc_queue_test)
+
+BOOST_AUTO_TEST_CASE(in_order) {
+  SpscQueue<int> queue(3);
+  std::thread producer([&] {
+    for (int i = 0; i < 1000; ++i) {
+      queue.push(i);
+    }
+    queue.close();
+  });
+
+  std::vector<int> values;
+  while (auto value = queue.pop()) {
+    values.push_back(*value);
+  }
+  producer.join();
+
+  BOOST_TEST(values.size() == 1000);
+  for (int i = 0; i < int(values.size()); ++i) {
+    BOOST_TEST(values[i] == i);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(bounded) {
+  SpscQueue<int> queue(2);
+  BOOST_TEST(queue.push(1));
+  BOOST_TEST(queue.push(2));
+
+  // Waits for space until closed
+  std::thread producer([&] { BOOST_TEST(!queue.push(3)); });
+  queue.close();
+  producer.join();
+
+  BOOST_TEST(*queue.pop() == 1);
+  BOOST_TEST(*queue.pop() == 2);
+  BOOST_TEST(!queue.pop());
+}
+
+BOOST_AUTO_TEST_CASE(closed_by_consumer) {
+  SpscQueue<int> queue(1);
+  std::thread producer([&] {
+    for (int i = 0; queue.push(i); ++i);
+  });
+  BOOST_TEST(*queue.pop() == 0);
+  queue.close();
+  producer.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
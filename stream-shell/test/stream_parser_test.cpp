@@ -1,5 +1,7 @@
 
 #include "stream-shell/stream_parser.h"
+#include <future>
+#include <limits>
 #include <string>
 #include <vector>
 #include <boost/test/unit_test.hpp>
@@ -7,7 +9,10 @@
 #include <google/protobuf/util/json_util.h>
 #include <google/protobuf/util/message_differencer.h>
 #include <range/v3/all.hpp>
+#include "stream-shell/builtins/merge.h"
+#include "stream-shell/builtins/zip.h"
 #include "stream-shell/operand_op.h"
+#include "stream-shell/parallel.h"
 #include "stream-shell/tokenize.h"
 #include "test_env.h"
 
@@ -27,6 +32,15 @@ auto &operator<<(std::ostream &os, const IsValue auto &value) {
   return os << str;
 }
 
+// Integers equal the JSON numbers they're converted to, e.g. in records
+bool operator==(const ::Value &lhs, const ::Value &rhs) {
+  auto json = [](const ::Value &value) -> ::Value {
+    auto *i = std::get_if<Int64Value>(&value);
+    return i ? ::Value(toNumber(*i)) : value;
+  };
+  return std::operator==(json(lhs), json(rhs));
+}
+
 auto &operator<<(std::ostream &os, const ::Value &value) {
   return std::visit([&](auto &value) -> auto & { return os << value; }, value);
 }
@@ -39,6 +53,12 @@ auto &operator<<(std::ostream &os, const Result<::Value> &value) {
 
 BOOST_AUTO_TEST_SUITE(stream_parser_test)
 
+google::protobuf::Value makeValue(std::nullptr_t) {
+  google::protobuf::Value v;
+  v.set_null_value({});
+  return v;
+}
+
 google::protobuf::Value makeValue(bool b) {
   google::protobuf::Value v;
   v.set_bool_value(b);
@@ -100,8 +120,73 @@ BOOST_AUTO_TEST_CASE(numbers) {
   BOOST_TEST(parse("1 + 2") == makeValues(3), each);
   BOOST_TEST(parse("1.5 - 0.75") == makeValues(.75), each);
   BOOST_TEST(parse("10 % 3") == makeValues(1), each);
+  BOOST_TEST(parse("1 < 2") == makeValues(true), each);
+  BOOST_TEST(parse("2 >= 10") == makeValues(false), each);
   BOOST_TEST(parse("1 2 3") == makeValues(1, 2, 3), each);
   BOOST_TEST(parse("1 2..4 5") == makeValues(1, 2, 3, 4, 5), each);
+  BOOST_TEST(parse("1e3 0.5 1.25E-2") == makeValues(1000, .5, .0125), each);
+}
+
+BOOST_AUTO_TEST_CASE(literals) {
+  BOOST_TEST(parse(R"("foo" "a\"b")") == makeValues("foo"sv, "a\"b"sv), each);
+  BOOST_TEST(parse("01 1.") == makeValues("01"sv, "1."sv), each);
+  BOOST_TEST(parse("null") == makeValues(nullptr), each);
+}
+
+BOOST_AUTO_TEST_CASE(ranges) {
+  BOOST_TEST(parse("1..3") == makeValues(1, 2, 3), each);
+  BOOST_TEST(parse("(1..3) * 2") == makeValues(2, 4, 6), each);
+  BOOST_TEST(parse("10 - (1..3)") == makeValues(9, 8, 7), each);
+  BOOST_TEST(parse("(1..3) + (1..5)") == makeValues(2, 4, 6), each);
+  BOOST_TEST(parse("-(1..2)") == makeValues(-1, -2), each);
+  BOOST_TEST(parse("(1..5) > 2") == makeValues(false, false, true, true, true), each);
+  BOOST_TEST(parse("(1..5) % 2 == 0") == makeValues(false, true, false, true, false), each);
+  BOOST_TEST(parse("(1..3) <= 2") == makeValues(true, true, false), each);
+  BOOST_TEST(parse("1..5000 | { i -> i }") == (ranges::views::iota(1, 5001) |
+                                                 ranges::views::transform([](int i) -> Value {
+                                                   return makeValue(i);
+                                                 }) |
+                                                 ranges::to<std::vector>),
+             each);
+}
+
+int64_t intValue(const Result<Value> &result) {
+  return std::get<google::protobuf::Int64Value>(result.value()).value();
+}
+
+BOOST_AUTO_TEST_CASE(integers) {
+  BOOST_TEST(intValue(parse("1..1").front()) == 1);
+  BOOST_TEST(intValue(parse("(1..1) * 3 % 2").front()) == 1);
+  BOOST_TEST(intValue(parse("1..1 | { i -> 0 - i }").front()) == -1);
+
+  // Exact beyond the 53 bits of a double
+  BOOST_TEST(intValue(parse("(9007199254740992..9007199254740992) + 1").front()) ==
+             9007199254740993);
+  BOOST_TEST(intValue(parse("9007199254740992..9007199254740992 | { i -> i + 1 }").front()) ==
+             9007199254740993);
+
+  // Computed on doubles when not exact on integers
+  BOOST_TEST(parse("(1..4) / 2") == makeValues(.5, 1, 1.5, 2), each);
+  BOOST_TEST(parse("(1..2) * 1.5") == makeValues(1.5, 3), each);
+  BOOST_TEST(parse("(4611686018427387904..4611686018427387904) * 4") ==
+                 makeValues(18446744073709551616.),
+             each);
+}
+
+BOOST_AUTO_TEST_CASE(range_bounds) {
+  constexpr auto max = std::numeric_limits<int64_t>::max();
+  auto ints = [](Stream stream) {
+    return stream | ranges::views::transform(intValue) | ranges::to<std::vector>;
+  };
+  BOOST_TEST(ints(Iota()(max - 1, max)) == std::vector<int64_t>({max - 1, max}), each);
+  BOOST_TEST(ints(Iota()(max)) == std::vector<int64_t>({max}), each);
+  BOOST_TEST(ints(unchunk(iotaChunks(max - 1))) == std::vector<int64_t>({max - 1, max}), each);
+  BOOST_TEST(ints(unchunk(iotaChunks(max, max))) == std::vector<int64_t>({max}), each);
+  BOOST_TEST(parse("3..1").empty());
+
+  // Bounds out of the range of integers
+  BOOST_TEST(parse("0..1e300").front().error() == Error::kInvalidNumberOp);
+  BOOST_TEST(parse("(0 - 1e300)..").front().error() == Error::kInvalidNumberOp);
 }
 
 BOOST_AUTO_TEST_CASE(strings) {
@@ -138,6 +223,15 @@ BOOST_AUTO_TEST_CASE(json) {
   BOOST_TEST(parse("{ foo: 'bar' }") == makeValues(JSON("{ foo: \"bar\" }")), each);
   BOOST_TEST(parse("{ name: `Bernard` }") == makeValues(JSON("{ name: \"Bernard\" }")), each);
   BOOST_TEST(parse("{ foo: { bar: 'baz' }}") == makeValues(JSON("{ foo: { bar: \"baz\" }}")), each);
+  BOOST_TEST(parse("1..2 | { i -> { n: i * 2 } }") ==
+                 makeValues(JSON("{ n: 2 }"), JSON("{ n: 4 }")),
+             each);
+  BOOST_TEST(parse("1..2 | { i -> { a: { b: [1, i] } } }") ==
+                 makeValues(JSON("{ a: { b: [1, 1] } }"), JSON("{ a: { b: [1, 2] } }")),
+             each);
+  BOOST_TEST(parse("1..2 | { i -> { n: 1..i } }") ==
+                 makeValues(JSON("{ n: 1 }"), JSON("{ n: [1, 2] }")),
+             each);
 }
 
 BOOST_AUTO_TEST_CASE(closure) {
@@ -151,16 +245,178 @@ BOOST_AUTO_TEST_CASE(closure) {
   BOOST_TEST(parse("{ numbers: [1, 2] } { numbers: [3, 4] } | { e -> e.numbers }") ==
                  makeValues(1, 2, 3, 4),
              each);
+  BOOST_TEST(parse("{ numbers: [1, 2] } | { e -> e.numbers e.numbers }") ==
+                 makeValues(1, 2, 1, 2),
+             each);
+  BOOST_TEST(parse("1..3 | add 1 | { x -> x }") == makeValues(2, 3, 4), each);
+  BOOST_TEST(parse("{ numbers: [1, 2] } | get numbers | { n -> n * 2 }") == makeValues(2, 4),
+             each);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_closure) {
+  BOOST_TEST(parse("1..4 | par 2 { i -> i * 2 }") == makeValues(2, 4, 6, 8), each);
+  BOOST_TEST(parse("1..2 | par { i -> i i }") == makeValues(1, 1, 2, 2), each);
+  BOOST_TEST(parse("1..3 | par 1 --unordered { add 1 }") == makeValues(2, 3, 4), each);
+  BOOST_TEST(parse("1..3 | par 1.5 { add 1 }").front().error() == Error::kConfigError);
+  BOOST_TEST(parse("1..2 | par 2 { i -> 1..2 | par 2 { j -> i * j } }") ==
+                 makeValues(1, 2, 2, 4),
+             each);
+  BOOST_TEST(parse("1..3 | add 1 | par 2 { x -> x }") == makeValues(2, 3, 4), each);
+  BOOST_TEST(parse("{ numbers: [1, 2] } | get numbers | par 2 { n -> n * 2 }") ==
+                 makeValues(2, 4),
+             each);
+
+  // The first value completes last, since it waits until the second one is evaluated
+  auto release = std::make_shared<std::promise<void>>();
+  StreamFactory closure = [release, released = release->get_future().share()](Stream input) {
+    auto result = *ranges::begin(input);
+    if (std::get<google::protobuf::Value>(*result).number_value() == 0) {
+      released.wait();
+    } else {
+      release->set_value();
+    }
+    return Stream(ranges::yield(std::move(result)));
+  };
+  auto input = ranges::views::iota(0, 2) | ranges::views::transform([](int i) -> Result<Value> {
+                 return makeValue(i);
+               });
+  google::protobuf::Struct config;
+  (*config.mutable_fields())["unordered"].set_bool_value(true);
+  auto results = parallelMap(input, closure, [&] { return closure; }, config) |
+                 ranges::to<std::vector<Result<Value>>>();
+  BOOST_TEST(results == makeValues(1, 0), each);
+}
+
+BOOST_AUTO_TEST_CASE(combined_streams) {
+  BOOST_TEST(parse("zip (1..3) (4..5) | { p -> p }") == makeValues(1, 4, 2, 5), each);
+  BOOST_TEST(parse("1..2 | zip ('a' 'b') | { p -> p }") == makeValues(1, "a"sv, 2, "b"sv), each);
+  BOOST_TEST(parse("merge (1..3)") == makeValues(1, 2, 3), each);
+  BOOST_TEST(parse("merge (1..2) (3..4) 5").size() == 5);
+
+  // Ends with an error rather than pairing up the values after it with the wrong ones
+  std::vector<Stream> inputs;
+  inputs.push_back(ranges::views::iota(0, 3) | ranges::views::transform([](int i) -> Result<Value> {
+                     if (i == 1) {
+                       return std::unexpected(Error::kInvalidOp);
+                     }
+                     return makeValue(i);
+                   }));
+  inputs.push_back(ranges::views::iota(0, 3) | ranges::views::transform([](int i) -> Result<Value> {
+                     return makeValue(i);
+                   }));
+  auto zipped = zip(std::move(inputs)) | ranges::to<std::vector<Result<Value>>>();
+  BOOST_REQUIRE(zipped.size() == 2);
+  BOOST_TEST(zipped[1].error() == Error::kInvalidOp);
+}
+
+// Yields |n| numbers, then waits until |released| like `tail -f log` waits for another line
+Stream blocking(int n, std::shared_future<void> released) {
+  return ranges::views::iota(0) | ranges::views::transform([=](int i) -> Result<Value> {
+           if (i >= n) {
+             released.wait();
+           }
+           return makeValue(i);
+         });
+}
+
+BOOST_AUTO_TEST_CASE(blocked_inputs) {
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  auto values = [](Stream stream) { return stream | ranges::to<std::vector<Result<Value>>>(); };
+
+  // Ends with the shorter input, although the other one is still waiting for its next value
+  std::vector<Stream> inputs;
+  inputs.push_back(ranges::views::iota(0, 2) | ranges::views::transform([](int i) -> Result<Value> {
+                     return makeValue(i);
+                   }));
+  inputs.push_back(blocking(2, released));
+  BOOST_TEST(values(zip(std::move(inputs))).size() == 2);
+
+  // Released before the inputs end
+  inputs.clear();
+  inputs.push_back(blocking(1, released));
+  BOOST_TEST(values(merge(std::move(inputs)) | ranges::views::take(1)) == makeValues(0), each);
+  BOOST_TEST(values(prefetch(blocking(1, released), {}) | ranges::views::take(1)) ==
+                 makeValues(0),
+             each);
+  release.set_value();
 }
 
 BOOST_AUTO_TEST_CASE(builtins) {
+  BOOST_TEST(parse("'foo' 'bar' | frame") == makeValues("foo"sv, "bar"sv), each);
+  BOOST_TEST(parse("'1' '2' | frame json") == makeValues(1, 2), each);
+  BOOST_TEST(parse("1..3 | add 1 | add 2") == makeValues(4, 5, 6), each);
+  BOOST_TEST(parse("{ numbers: [1, 2] } | get numbers | add 1") == makeValues(2, 3), each);
+  BOOST_TEST(parse("1..5 | prefetch 2 | add 1") == makeValues(2, 3, 4, 5, 6), each);
+  BOOST_TEST(parse("1..3 | buffer | { i -> i * 2 }") == makeValues(2, 4, 6), each);
+  BOOST_TEST(parse("1..3 | prefetch 0").front().error() == Error::kConfigError);
+  BOOST_TEST(parse("1..3 | prefetch 1.5").front().error() == Error::kConfigError);
+  BOOST_TEST(parse("1..3 | prefetch 1e12") == makeValues(1, 2, 3), each);
+  BOOST_TEST(parse("hash -r").empty());
   // todo: fake exit
   // BOOST_TEST(parse("exit") == makeValues(2, 3), each);
 }
 
+BOOST_AUTO_TEST_CASE(background) {
+  BOOST_TEST(parse("1..3 &") == makeValues("$job"sv), each);
+  BOOST_TEST(parse("1..3 | add 1 &") == makeValues("$job"sv), each);
+  BOOST_TEST(parse("1..3 & 4") == makeValues(4), each);
+}
+
+BOOST_AUTO_TEST_CASE(cancel) {
+  struct JobEnv : TestEnv {
+    bool interrupt(const StreamRef &job) override {
+      jobs.push_back(job.name);
+      return job.name != "unknown";
+    }
+    std::vector<std::string> jobs;
+  } env;
+  auto parse = [&](std::string_view source) {
+    return makeStreamParser(env)->parse(source) | ranges::to<std::vector<Result<Value>>>();
+  };
+
+  BOOST_TEST(parse("cancel '$1234-1' '1234-2'").empty());
+  BOOST_TEST(env.jobs == std::vector<std::string>({"1234-1", "1234-2"}), each);
+  BOOST_TEST(parse("cancel 'unknown'").front().error() == Error::kInvalidStreamRef);
+}
+
 BOOST_AUTO_TEST_CASE(closure_regression) {
   BOOST_TEST(parse("1..3 | { 1 | 2 }") == makeValues(2, 2, 2), each);
   BOOST_TEST(parse("1..3 | { 1..2 | 2 }") == makeValues(2, 2, 2), each);
 }
 
+BOOST_AUTO_TEST_CASE(source_cache) {
+  struct AssignmentEnv : TestEnv {
+    void setEnv(StreamRef, StreamFactory) override { ++assignments; }
+    int assignments = 0;
+  } env;
+  auto parser = makeStreamParser(env);
+
+  for (auto i = 0; i < 2; ++i) {
+    // The source only lives until the stream is returned
+    auto numbers = parser->parse(std::string_view(std::string("1..3 | add 1")));
+    BOOST_TEST((numbers | ranges::to<std::vector<Result<Value>>>()) == makeValues(2, 3, 4), each);
+
+    auto records = parser->parse("{ numbers: [1, 2] } | { e -> e.numbers }"sv);
+    BOOST_TEST((records | ranges::to<std::vector<Result<Value>>>()) == makeValues(1, 2), each);
+
+    BOOST_TEST((parser->parse("$foo = 1"sv) | ranges::to<std::vector<Result<Value>>>()).empty());
+  }
+  // Assignments are parsed, and thereby performed, every time
+  BOOST_TEST(env.assignments == 2);
+
+  // Parallel closures parse their tokens again, keeping the source alive although it isn't cached
+  auto doubled =
+      parser->parse(std::string_view(std::string("$foo = 1; 1..3 | par 2 { i -> i * 2 }")));
+  BOOST_TEST((doubled | ranges::to<std::vector<Result<Value>>>()) == makeValues(2, 4, 6), each);
+
+  // Least recently used sources are parsed again once more distinct ones were seen
+  for (auto i = 0; i < 1000; ++i) {
+    auto number = parser->parse(std::string_view(std::to_string(i)));
+    BOOST_TEST((number | ranges::to<std::vector<Result<Value>>>()) == makeValues(i), each);
+  }
+  auto numbers = parser->parse("1..3 | add 1"sv);
+  BOOST_TEST((numbers | ranges::to<std::vector<Result<Value>>>()) == makeValues(2, 3, 4), each);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <unistd.h>
+#include "stream-shell/process_stream.h"
 #include "stream-shell/stream_parser.h"
 
 struct TestEnv : Env {
@@ -7,4 +9,13 @@ struct TestEnv : Env {
   void setEnv(StreamRef, StreamFactory) override {}
   bool sleepUntil(std::chrono::steady_clock::time_point) override { return true; }
   ssize_t read(int fd, google::protobuf::BytesValue &bytes) override { return -1; }
+  void close(int fd) override { ::close(fd); }
+  StreamRef background(Stream stream) override {
+    ranges::for_each(std::move(stream), [](auto &&) {});
+    return {"job"};
+  }
+  bool interrupt(const StreamRef &) override { return false; }
+  std::shared_ptr<ProcessStream> processStream(std::string) override {
+    return std::make_shared<ProcessStream>();
+  }
 };
@@ -48,6 +48,8 @@ BOOST_AUTO_TEST_CASE(tokenize_stream_variable) {
   BOOST_TEST(tokens("$MY_VAR") == Tokens({"$MY_VAR"}), kEach);
   BOOST_TEST(tokens("$1234") == Tokens({"$1234"}), kEach);
   BOOST_TEST(tokens("$DASH-VAR") == Tokens({"$DASH-VAR"}), kEach);
+  BOOST_TEST(tokens("add_one $*") == Tokens({"add_one", "$*"}), kEach);
+  BOOST_TEST(tokens("$*|$1") == Tokens({"$*", "|", "$1"}), kEach);
   BOOST_TEST(tokens("$HOME=/Users/hultman") == Tokens({"$HOME", "=", "/Users/hultman"}), kEach);
 }
 
@@ -136,4 +138,12 @@ BOOST_AUTO_TEST_CASE(tokenize_complex) {
              kEach);
 }
 
+BOOST_AUTO_TEST_CASE(tokenize_slices) {
+  auto input = "ls | { f -> f.name }"sv;
+  auto t = splitTokens(input);
+  BOOST_TEST(t == std::vector({"ls"sv, "|"sv, "{"sv, "f"sv, "->"sv, "f.name"sv, "}"sv}), kEach);
+  BOOST_TEST(t.front().data() == input.data());
+  BOOST_TEST(t.back().data() == input.data() + input.size() - 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
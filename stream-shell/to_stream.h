@@ -13,13 +13,14 @@ struct ToStream {
   auto operator()(const IsValue auto &value) const -> Stream { return ranges::yield(value); }
   auto operator()(const google::protobuf::Value &value) const -> Stream {
     if (value.has_list_value()) {
-      auto list = value.list_value();
-      return ranges::views::iota(0, list.values().size()) |
-             ranges::views::transform([list](auto i) { return list.values(i); });
+      // Refers to the list of the operand, which outlives the stream, copying items only as read
+      return value.list_value().values() |
+             ranges::views::transform([](auto &item) -> Result<Value> { return item; });
     }
     return ranges::yield(value);
   }
   auto operator()(const Stream &stream) const { return stream; }
+  auto operator()(const ChunkStream &chunks) const -> Stream { return unchunk(chunks); }
   auto operator()(const StreamRef &ref) const -> Stream {
     if (auto it = _scope.env_overrides.find(ref.name); it != _scope.env_overrides.end()) {
       return it->second({});
@@ -35,6 +35,9 @@ struct ToString final {
       }
       return (*this)(static_cast<const google::protobuf::Message &>(val));
     }
+    auto operator()(const google::protobuf::Int64Value &val) const -> Result {
+      return std::to_string(val.value());
+    }
 
     auto operator()(const ::Value &value) const -> Result { return std::visit(*this, value); }
   };
@@ -69,6 +72,7 @@ struct ToString final {
     //
     auto operator()(const StreamRef &ref) const -> Result { return (*this)(this, ref); }
     auto operator()(Stream stream) const -> Result { return (*this)(this, stream); }
+    auto operator()(ChunkStream chunks) const -> Result { return (*this)(this, unchunk(chunks)); }
 
     auto operator()(const ::Operand &operand) const -> Result { return std::visit(*this, operand); }
 
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <google/protobuf/any.pb.h>
+#include <google/protobuf/struct.pb.h>
+#include "stream_parser.h"
+
+/**
+ * Collects |stream| into a single JSON value, e.g. for a record field. A single value is kept as
+ * is, no values make null, and any other number of values make a list.
+ */
+inline auto toValue(Stream stream) -> Result<google::protobuf::Value> {
+  google::protobuf::Value list;
+  auto &values = *list.mutable_list_value()->mutable_values();
+  for (auto &&result : stream) {
+    if (!result) {
+      return std::unexpected(result.error());
+    }
+    auto &item = *values.Add();
+    if (auto *bytes = std::get_if<google::protobuf::BytesValue>(&*result)) {
+      // todo: base64 encode
+      item.set_string_value(bytes->Utf8DebugString());
+    } else if (auto *value = std::get_if<google::protobuf::Value>(&*result)) {
+      item = std::move(*value);
+    } else if (auto *i = std::get_if<google::protobuf::Int64Value>(&*result)) {
+      item.set_number_value(i->value());
+    } else if (auto *any = std::get_if<google::protobuf::Any>(&*result)) {
+      // todo: something
+      item.set_string_value(any->Utf8DebugString());
+    }
+  }
+
+  if (values.empty()) {
+    google::protobuf::Value null;
+    null.set_null_value({});
+    return null;
+  } else if (values.size() == 1) {
+    return std::move(values[0]);
+  }
+  return list;
+}
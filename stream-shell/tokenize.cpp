@@ -1,142 +1,228 @@
 #include "tokenize.h"
 
-#include <variant>
-#include "util/trim.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <utility>
 
 namespace {
 
 using namespace std::string_view_literals;
 
-struct Tokenizer {
-  struct Init {};
-  struct Word {
-    bool is_path = false;
-  };
-  struct Operator {
-    char first = 0;
-  };
-  struct Number {
-    enum Base { kUnknown, kDec, kHex } base = {};
-  };
-  struct String {
-    char type = 0;
+enum CharClass : uint8_t {
+  kQuote = 1 << 0,
+  kOperator = 1 << 1,
+  kDigit = 1 << 2,
+  kHexDigit = 1 << 3,
+  kSpace = 1 << 4,
+  // Always delimits a token
+  kBracket = 1 << 5,
+  // Delimits a token, unless it's part of a word
+  kSeparator = 1 << 6,
+  // Valid in a stream variable name
+  kName = 1 << 7,
+};
+
+constexpr auto kCharClasses = [] {
+  std::array<uint8_t, 256> classes = {};
+  auto set = [&](std::string_view chars, uint8_t c) {
+    for (auto ch : chars) classes[uint8_t(ch)] |= c;
   };
-  struct StreamRef {};
-  using Type = std::variant<Init, Word, Operator, Number, String, StreamRef>;
-
-  bool operator()(const Init &, char c) {
-    if (ranges::contains("\"'`"sv, c)) {
-      _type = String(c);
-    } else if (ranges::contains("!&%+-*/<=>|"sv, c)) {
-      _type = Operator(c);
-    } else if (std::isdigit(c)) {
-      _type = Number(c == '0' ? Number::kUnknown : Number::kDec);
+  constexpr auto digits = "0123456789"sv;
+  constexpr auto letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"sv;
+  set("\"'`", kQuote);
+  set("!&%+-*/<=>|", kOperator);
+  set(digits, kDigit);
+  set(digits, kHexDigit);
+  set("abcdefABCDEF", kHexDigit);
+  set(" \t\n\v\f\r", kSpace);
+  set("(){}[]\"'`", kBracket);
+  set(";:,", kSeparator);
+  set(digits, kName);
+  set(letters, kName);
+  set("-_", kName);
+  return classes;
+}();
+
+constexpr bool is(char c, uint8_t classes) {
+  return kCharClasses[uint8_t(c)] & classes;
+}
+
+/**
+ * State machine deciding, for each character, whether it continues the current token.
+ */
+struct Tokenizer {
+  enum class Type { kInit, kWord, kOperator, kNumber, kString, kStreamRef };
+  enum class Base { kUnknown, kDec, kHex };
+
+  // Begins a token at |c|, which is never part of the previous one
+  bool start(char c) {
+    if (is(c, kQuote)) {
+      _type = Type::kString;
+      _quote = c;
+    } else if (is(c, kOperator)) {
+      _type = Type::kOperator;
+      _first = c;
+    } else if (is(c, kDigit)) {
+      _type = Type::kNumber;
+      _base = c == '0' ? Base::kUnknown : Base::kDec;
     } else if (c == '$') {
-      _type = StreamRef();
-    } else if (std::isspace(c) || ranges::contains("(){}[]\"'`;:,"sv, c)) {
-      _type = Init();
+      _type = Type::kStreamRef;
+      _first = c;
+    } else if (is(c, kSpace | kBracket | kSeparator)) {
+      _type = Type::kInit;
     } else {
-      _type = Word{.is_path = ranges::contains("./"sv, c)};
+      _type = Type::kWord;
+      _is_path = c == '.' || c == '/';
     }
     return false;
   }
 
-  bool operator()(const Word &w, char c) {
-    if (std::isspace(c) || ranges::contains("(){}[]\"'`"sv, c)) {
-      return (*this)(Init(), c);
+  bool next(char c) {
+    switch (_type) {
+      case Type::kInit:
+        return start(c);
+      case Type::kWord:
+        return word(c, _is_path);
+      case Type::kOperator:
+        return op(c);
+      case Type::kNumber:
+        return number(c);
+      case Type::kString:
+        return string(c);
+      case Type::kStreamRef:
+        return streamRef(c);
     }
-    if (c == '=' && !w.is_path) {
-      return (*this)(Init(), c);
+    return start(c);
+  }
+
+ private:
+  bool word(char c, bool is_path) {
+    if (is(c, kSpace | kBracket) || (c == '=' && !is_path)) {
+      return start(c);
     }
     return true;
   }
 
-  bool operator()(Operator &op, char c) {
-    constexpr auto ops = std::array{"<=", "==", ">=", "!=", "&&", "||", "->"};
-    if (op.first && ranges::contains(ops, std::string{op.first, c})) {
-      op.first = 0;
+  bool op(char c) {
+    if (_first && isOperatorPair(_first, c)) {
+      _first = 0;
       return true;
-    } else if (ranges::contains("-/"sv, op.first) && !std::isdigit(c)) {
-      return (*this)(Word(), c);
+    } else if ((_first == '-' || _first == '/') && !is(c, kDigit)) {
+      // Options and paths, e.g. --foo or /usr
+      return word(c, false);
     }
-    return (*this)(Init(), c);
+    return start(c);
   }
 
-  bool operator()(Number &num, char c) {
-    switch (num.base) {
-      case Number::kUnknown:
+  bool streamRef(char c) {
+    if (std::exchange(_first, 0) == '$' && c == '*') {
+      // All script arguments, e.g. $*
+      _type = Type::kInit;
+      return true;
+    }
+    return is(c, kName) || start(c);
+  }
+
+  bool number(char c) {
+    switch (_base) {
+      case Base::kUnknown:
         if (c == 'x') {
-          num.base = Number::kHex;
+          _base = Base::kHex;
           return true;
         }
         [[fallthrough]];
-      case Number::kDec:
-        if (std::isdigit(c) || c == '.') return true;
+      case Base::kDec:
+        if (is(c, kDigit) || c == '.') return true;
         break;
-      case Number::kHex:
-        if (std::isxdigit(c)) return true;
+      case Base::kHex:
+        if (is(c, kHexDigit)) return true;
         break;
     }
-    return (*this)(Init(), c);
+    return start(c);
   }
 
-  bool operator()(String &str, char c) {
-    if (!str.type) {
-      return (*this)(Init(), c);
-    } else if (c == str.type) {
-      str.type = 0;
-    }
-    return true;
-  }
-  bool operator()(StreamRef &, char c) {
-    if (!std::isalnum(c) && !ranges::contains("-_"sv, c)) {
-      return (*this)(Init(), c);
+  bool string(char c) {
+    if (!_quote) {
+      return start(c);
+    } else if (c == _quote) {
+      _quote = 0;
     }
-    _type = StreamRef();
     return true;
   }
 
- public:
-  bool operator()(auto t1, auto t2) {
-    auto [i, a] = t1;
-    if (!i) {
-      (*this)(Init(), a);
+  static bool isOperatorPair(char a, char b) {
+    switch (b) {
+      case '=':
+        return a == '<' || a == '=' || a == '>' || a == '!';
+      case '&':
+      case '|':
+        return a == b;
+      case '>':
+        return a == '-';
     }
-    auto [_, b] = t2;
-    return std::visit(*this, _type, std::variant<char>{b});
+    return false;
   }
 
- private:
-  Type _type;
+  Type _type = Type::kInit;
+  char _first = 0;
+  char _quote = 0;
+  Base _base = Base::kUnknown;
+  bool _is_path = false;
 };
 
-using Token = ranges::any_view<const char, ranges::category::bidirectional>;
+void appendToken(std::string_view token, std::vector<std::string_view> &out) {
+  auto push = [&](std::string_view token) {
+    if (!token.empty()) out.push_back(token);
+  };
+  auto push_range = [&](std::string_view token) {
+    if (auto dots = token.find(".."); dots != std::string_view::npos) {
+      push(token.substr(0, dots));
+      push(token.substr(dots, 2));
+      push(token.substr(dots + 2));
+    } else {
+      push(token);
+    }
+  };
+
+  while (!token.empty() && is(token.front(), kSpace)) token.remove_prefix(1);
+  while (!token.empty() && is(token.back(), kSpace)) token.remove_suffix(1);
+
+  if (token.ends_with(';')) {
+    push_range(token.substr(0, token.size() - 1));
+    push_range(token.substr(token.size() - 1));
+  } else {
+    push_range(token);
+  }
+}
 
 }  // namespace
 
-auto tokenize(Token input) -> ranges::any_view<Token> {
-  auto tokenizer = std::make_shared<Tokenizer>();
-  return ranges::views::enumerate(input) |
-         ranges::views::chunk_by([tokenizer](auto... t) { return (*tokenizer)(t...); }) |
-         ranges::views::transform([](auto &&t) { return t | ranges::views::values; }) |
-         ranges::views::transform([](auto &&s) { return trim(std::forward<decltype(s)>(s)); }) |
-         ranges::views::for_each([](auto &&s) {
-           auto head = Token(s), tail = Token();
-           if (!ranges::empty(s) && ranges::back(s) == ';') {
-             head = trim(s, 0, 1);
-             tail = trim(s, ranges::distance(s) - 1);
-           }
-           return ranges::views::concat(ranges::yield(head), ranges::yield(tail));
-         }) |
-         ranges::views::for_each([](auto &&s) -> ranges::any_view<Token> {
-           auto [db, de] = ranges::search(s, ".."sv);
-           if (db == ranges::end(s)) {
-             return ranges::yield(s);
-           }
-           return ranges::views::concat(
-               ranges::yield(Token(ranges::make_subrange(ranges::begin(s), db))),
-               ranges::yield(Token(ranges::make_subrange(db, de))),
-               ranges::yield(Token(ranges::make_subrange(de, ranges::end(s)))));
-         }) |
-         ranges::views::filter([](auto &&s) { return !ranges::empty(s); });
+auto splitTokens(std::string_view input) -> std::vector<std::string_view> {
+  std::vector<std::string_view> tokens;
+  if (input.empty()) {
+    return tokens;
+  }
+
+  Tokenizer tokenizer;
+  tokenizer.start(input[0]);
+
+  size_t begin = 0;
+  for (size_t i = 1; i < input.size(); ++i) {
+    if (!tokenizer.next(input[i])) {
+      appendToken(input.substr(begin, i - begin), tokens);
+      begin = i;
+    }
+  }
+  appendToken(input.substr(begin), tokens);
+  return tokens;
+}
+
+auto tokenize(std::string_view input)
+    -> ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>> {
+  auto tokens = std::make_shared<std::vector<std::string_view>>(splitTokens(input));
+  return ranges::views::iota(size_t(0), tokens->size()) |
+         ranges::views::transform([tokens](size_t i) {
+           return ranges::any_view<const char, ranges::category::bidirectional>((*tokens)[i]);
+         });
 }
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <string_view>
+#include <vector>
 #include <range/v3/all.hpp>
 
-auto tokenize(ranges::any_view<const char, ranges::category::bidirectional>)
+/**
+ * Splits |input| into tokens, as slices of it.
+ */
+auto splitTokens(std::string_view input) -> std::vector<std::string_view>;
+
+/**
+ * Tokens of |input| for the parser. The tokens refer to |input|, which must outlive them.
+ */
+auto tokenize(std::string_view input)
     -> ranges::any_view<ranges::any_view<const char, ranges::category::bidirectional>>;
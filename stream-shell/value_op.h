@@ -1,16 +1,25 @@
 #pragma once
 
+#include "chunk.h"
+#include "kernels.h"
 #include "stream_parser.h"
 
 #include <google/protobuf/any.pb.h>
 #include <google/protobuf/struct.pb.h>
 #include <google/protobuf/util/json_util.h>
+#include <google/protobuf/wrappers.pb.h>
 
 /**
- * Given a template functor, try performing the operation on 1 to 2 primitives.
+ * Given a template functor, try performing the operation on 1 to 2 primitives, or element-wise on
+ * chunks of primitives. Operations on integers, and integral numbers paired with them, are exact
+ * unless they divide or overflow, in which case they're computed on doubles.
  */
 template <typename Op, typename Type = void>
 struct ValueOp {
+  // Operations producing streams, such as ranges, can't be applied on chunks
+  static constexpr bool kChunked = !std::is_invocable_r_v<Stream, Op, int64_t> &&
+                                   !std::is_invocable_r_v<Stream, Op, int64_t, int64_t>;
+
   Stream operator()(const google::protobuf::Value &val) {
     google::protobuf::Value result;
     if (val.has_number_value()) {
@@ -21,7 +30,10 @@ struct ValueOp {
         result.set_number_value(Op()(val.number_value()));
 
       } else if constexpr (std::is_invocable_r_v<Stream, Op, int64_t>) {
-        return Op()(int64_t(val.number_value()));
+        if (auto i = rangeBound(val)) {
+          return Op()(*i);
+        }
+        return ranges::yield(std::unexpected(Error::kInvalidNumberOp));
 
       } else {
         return ranges::yield(std::unexpected(Error::kInvalidNumberOp));
@@ -49,10 +61,34 @@ struct ValueOp {
     return ranges::yield(result);
   }
 
+  Stream operator()(const google::protobuf::Int64Value &val) {
+    if constexpr (std::is_invocable_r_v<Stream, Op, int64_t>) {
+      return Op()(val.value());
+
+    } else if constexpr (std::is_same_v<Op, std::identity>) {
+      return ranges::yield(val);
+
+    } else if constexpr (std::is_same_v<Op, std::negate<>>) {
+      // Subtracted from 0, which detects overflow
+      int64_t zero = 0, i = val.value(), out;
+      if (runKernel(Kernel::kSub, &zero, 1, &i, 1, &out, 1)) {
+        return ranges::yield(makeInt(out));
+      }
+    }
+    return (*this)(toNumber(val));
+  }
+
   Stream operator()(const google::protobuf::Value &lhs, const google::protobuf::Value &rhs) {
     google::protobuf::Value result;
     if (lhs.has_number_value() && rhs.has_number_value()) {
-      if constexpr (std::is_invocable_r_v<bool, Op, bool, bool> && std::is_same_v<Type, bool>) {
+      if constexpr (kKernel<Op>.has_value()) {
+        // Same kernel as for chunks, so that single values and chunks agree
+        double l = lhs.number_value(), r = rhs.number_value(), out;
+        runKernel(*kKernel<Op>, &l, 1, &r, 1, &out, 1);
+        std::is_same_v<Type, bool> ? result.set_bool_value(out) : result.set_number_value(out);
+
+      } else if constexpr (std::is_invocable_r_v<bool, Op, bool, bool> &&
+                           std::is_same_v<Type, bool>) {
         result.set_bool_value(Op()(bool(lhs.number_value()), bool(rhs.number_value())));
 
       } else if constexpr (std::is_invocable_r_v<double, Op, double, double>) {
@@ -62,7 +98,10 @@ struct ValueOp {
         result.set_number_value(Op()(int64_t(lhs.number_value()), int64_t(rhs.number_value())));
 
       } else if constexpr (std::is_invocable_r_v<Stream, Op, int64_t, int64_t>) {
-        return Op()(int64_t(lhs.number_value()), int64_t(rhs.number_value()));
+        if (auto l = rangeBound(lhs), r = rangeBound(rhs); l && r) {
+          return Op()(*l, *r);
+        }
+        return ranges::yield(std::unexpected(Error::kInvalidNumberOp));
 
       } else {
         return ranges::yield(std::unexpected(Error::kInvalidNumberOp));
@@ -93,5 +132,164 @@ struct ValueOp {
     return ranges::yield(result);
   }
 
+  Stream operator()(const google::protobuf::Int64Value &lhs,
+                    const google::protobuf::Int64Value &rhs) {
+    if constexpr (std::is_invocable_r_v<Stream, Op, int64_t, int64_t>) {
+      return Op()(lhs.value(), rhs.value());
+
+    } else if constexpr (kKernel<Op>.has_value()) {
+      int64_t l = lhs.value(), r = rhs.value(), out;
+      if (runKernel(*kKernel<Op>, &l, 1, &r, 1, &out, 1)) {
+        if constexpr (std::is_same_v<Type, bool>) {
+          google::protobuf::Value result;
+          result.set_bool_value(out);
+          return ranges::yield(result);
+        } else {
+          return ranges::yield(makeInt(out));
+        }
+      }
+    }
+    return (*this)(toNumber(lhs), toNumber(rhs));
+  }
+  Stream operator()(const google::protobuf::Int64Value &lhs, const google::protobuf::Value &rhs) {
+    if (auto r = toInt(rhs)) {
+      return (*this)(lhs, makeInt(*r));
+    }
+    return (*this)(toNumber(lhs), rhs);
+  }
+  Stream operator()(const google::protobuf::Value &lhs, const google::protobuf::Int64Value &rhs) {
+    if (auto l = toInt(lhs)) {
+      return (*this)(makeInt(*l), rhs);
+    }
+    return (*this)(lhs, toNumber(rhs));
+  }
+
+  Result<Chunk> operator()(const Chunk &val)
+    requires kChunked
+  {
+    if (val.kind == Chunk::Kind::kInt) {
+      if constexpr (std::is_same_v<Op, std::negate<>>) {
+        Chunk result = {.kind = Chunk::Kind::kInt, .valid = val.valid, .scalar = val.scalar};
+        result.ints.resize(val.size());
+        int64_t zero = 0;
+        if (runKernel(
+                Kernel::kSub, &zero, 0, val.ints.data(), 1, result.ints.data(), val.size())) {
+          return result;
+        }
+      }
+      return (*this)(val.toNumbers());
+    }
+
+    Chunk result = {.valid = val.valid};
+    result.values.resize(val.size());
+    if (val.kind == Chunk::Kind::kNumber) {
+      if constexpr (std::is_invocable_r_v<bool, Op, bool> && std::is_same_v<Type, bool>) {
+        result.kind = Chunk::Kind::kBool;
+        for (size_t i = 0; i < val.size(); ++i) result.values[i] = Op()(bool(val.values[i]));
+
+      } else if constexpr (std::is_invocable_r_v<double, Op, double>) {
+        for (size_t i = 0; i < val.size(); ++i) result.values[i] = Op()(val.values[i]);
+
+      } else {
+        return std::unexpected(Error::kInvalidNumberOp);
+      }
+
+    } else if constexpr (std::is_invocable_r_v<bool, Op, bool>) {
+      result.kind = Chunk::Kind::kBool;
+      for (size_t i = 0; i < val.size(); ++i) result.values[i] = Op()(bool(val.values[i]));
+
+    } else {
+      return std::unexpected(Error::kInvalidBoolOp);
+    }
+    return result;
+  }
+
+  Result<Chunk> operator()(const Chunk &lhs, const Chunk &rhs)
+    requires kChunked
+  {
+    // Scalars are broadcast by indexing with a stride of 0
+    auto l = lhs.scalar ? 0 : 1, r = rhs.scalar ? 0 : 1;
+    auto n = lhs.scalar ? rhs.size() : rhs.scalar ? lhs.size() : std::min(lhs.size(), rhs.size());
+
+    if (lhs.kind == Chunk::Kind::kInt && rhs.kind != Chunk::Kind::kInt) {
+      return (*this)(lhs.toNumbers(), rhs);
+    } else if (lhs.kind != Chunk::Kind::kInt && rhs.kind == Chunk::Kind::kInt) {
+      return (*this)(lhs, rhs.toNumbers());
+    }
+
+    Chunk result;
+    if (!lhs.valid.empty() || !rhs.valid.empty()) {
+      result.valid.resize(n);
+      for (size_t i = 0; i < n; ++i) result.valid[i] = lhs.isValid(i * l) && rhs.isValid(i * r);
+    }
+
+    if (lhs.kind == Chunk::Kind::kInt) {
+      if constexpr (kKernel<Op>.has_value()) {
+        std::vector<int64_t> ints(n);
+        if (runKernel(*kKernel<Op>, lhs.ints.data(), l, rhs.ints.data(), r, ints.data(), n)) {
+          if constexpr (std::is_same_v<Type, bool>) {
+            result.kind = Chunk::Kind::kBool;
+            result.values.assign(ints.begin(), ints.end());
+          } else {
+            result.kind = Chunk::Kind::kInt;
+            result.ints = std::move(ints);
+          }
+          return result;
+        }
+      }
+      return (*this)(lhs.toNumbers(), rhs.toNumbers());
+    }
+
+    result.values.resize(n);
+    if (lhs.kind == Chunk::Kind::kNumber && rhs.kind == Chunk::Kind::kNumber) {
+      if constexpr (kKernel<Op>.has_value()) {
+        result.kind = std::is_same_v<Type, bool> ? Chunk::Kind::kBool : Chunk::Kind::kNumber;
+        runKernel(
+            *kKernel<Op>, lhs.values.data(), l, rhs.values.data(), r, result.values.data(), n);
+
+      } else if constexpr (std::is_invocable_r_v<bool, Op, bool, bool> &&
+                           std::is_same_v<Type, bool>) {
+        result.kind = Chunk::Kind::kBool;
+        for (size_t i = 0; i < n; ++i) {
+          result.values[i] = Op()(bool(lhs.values[i * l]), bool(rhs.values[i * r]));
+        }
+
+      } else if constexpr (std::is_invocable_r_v<double, Op, double, double>) {
+        for (size_t i = 0; i < n; ++i) {
+          result.values[i] = Op()(lhs.values[i * l], rhs.values[i * r]);
+        }
+
+      } else if constexpr (std::is_invocable_r_v<int64_t, Op, int64_t, int64_t>) {
+        for (size_t i = 0; i < n; ++i) {
+          result.values[i] = Op()(int64_t(lhs.values[i * l]), int64_t(rhs.values[i * r]));
+        }
+
+      } else {
+        return std::unexpected(Error::kInvalidNumberOp);
+      }
+
+    } else if (lhs.kind == Chunk::Kind::kBool && rhs.kind == Chunk::Kind::kBool) {
+      if constexpr (kKernel<Op>.has_value() && std::is_same_v<Type, bool>) {
+        // Bools are stored as 0 or 1, so comparisons and logical operations apply as is
+        result.kind = Chunk::Kind::kBool;
+        runKernel(
+            *kKernel<Op>, lhs.values.data(), l, rhs.values.data(), r, result.values.data(), n);
+
+      } else if constexpr (std::is_invocable_r_v<bool, Op, bool, bool>) {
+        result.kind = Chunk::Kind::kBool;
+        for (size_t i = 0; i < n; ++i) {
+          result.values[i] = Op()(bool(lhs.values[i * l]), bool(rhs.values[i * r]));
+        }
+
+      } else {
+        return std::unexpected(Error::kInvalidBoolOp);
+      }
+
+    } else {
+      return std::unexpected(Error::kInvalidOp);
+    }
+    return result;
+  }
+
   Stream operator()(const auto &...) { return ranges::yield(std::unexpected(Error::kInvalidOp)); }
 };
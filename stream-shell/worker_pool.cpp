@@ -0,0 +1,56 @@
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool(size_t size) : _size{size} {}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard lock(_mutex);
+    _shutdown = true;
+    _tasks.clear();
+  }
+  _cv.notify_all();
+  for (auto &thread : _threads) {
+    thread.join();
+  }
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard lock(_mutex);
+    _tasks.push_back(std::move(task));
+    if (_threads.size() < _size) {
+      _threads.emplace_back([this] { run(); });
+    }
+  }
+  _cv.notify_one();
+}
+
+bool WorkerPool::runPending() {
+  std::function<void()> task;
+  {
+    std::lock_guard lock(_mutex);
+    if (_tasks.empty()) {
+      return false;
+    }
+    task = std::move(_tasks.front());
+    _tasks.pop_front();
+  }
+  task();
+  return true;
+}
+
+void WorkerPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(_mutex);
+      _cv.wait(lock, [this] { return _shutdown || !_tasks.empty(); });
+      if (_shutdown) {
+        return;
+      }
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
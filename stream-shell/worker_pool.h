@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed number of threads running submitted tasks in order, started on the first submission.
+ * Tasks still queued when the pool is destroyed are dropped, while running ones are joined.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(size_t size = std::max(2u, std::thread::hardware_concurrency()));
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  /**
+   * Runs the next queued task on the calling thread, if any. For threads waiting on tasks, so that
+   * tasks waiting on tasks can't occupy every thread of the pool.
+   */
+  bool runPending();
+
+ private:
+  void run();
+
+  size_t _size;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<std::function<void()>> _tasks;
+  std::vector<std::thread> _threads;
+  bool _shutdown = false;
+};